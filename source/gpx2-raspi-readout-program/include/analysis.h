@@ -0,0 +1,82 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "hit.h"
+#include "coincidence.h"
+#include "codec.h"
+#include "statistics.h"
+#include "timing.h"
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// histogram with fixed bin width, integer counts so partial histograms merge exactly
+struct Histogram {
+	std::int64_t min_ps{};
+	std::int64_t bin_ps{ 1 };
+	std::vector<std::uint64_t> counts{};
+	std::uint64_t underflow{};
+	std::uint64_t overflow{};
+
+	Histogram() = default;
+	Histogram(std::int64_t min, std::int64_t max, std::int64_t bin);
+
+	void add(std::int64_t value);
+	void merge(const Histogram& other);
+};
+
+// result of the analysis of a recorded run or of a part of it
+struct AnalysisResult {
+	std::uint64_t hits{};
+	std::uint64_t events{};
+	std::uint64_t checksum{}; // over all events in time order, equal for equal results
+	std::array<Histogram, PairStatistics::pairs> intervals{}; // interval between the channels of each pair in coincidences
+	PairStatistics statistics{};
+
+	// other has to be the result of the following part of the run
+	void merge(const AnalysisResult& other);
+	void print(std::ostream& out) const;
+};
+
+// offline analysis of recorded runs in the block format of codec.h on all cores.
+// the run is split into chunks of about chunk_hits hits at block boundaries. every chunk is analysed
+// together with margin_ps of hits before and after it, so windows crossing the boundaries are found,
+// but only the coincidences starting inside the chunk are counted. the partial results are merged
+// in the order of the chunks, so the result does not depend on the number of threads.
+class OfflineAnalysis {
+public:
+	struct Settings {
+		std::vector<CoincidenceGroup> groups{};
+		Calibration calibration{};
+		std::size_t chunk_hits{ std::size_t{ 1 } << 22U };
+		std::int64_t margin_ps{ 0 }; // 0: ten times the longest window including delays
+		std::int64_t histogram_bin_ps{ 100 };
+		unsigned threads{ std::thread::hardware_concurrency() };
+	};
+
+	explicit OfflineAnalysis(Settings settings);
+
+	// on_events is called with the coincidences of each chunk in time order, from the calling thread
+	[[nodiscard]] auto run(const std::string& file, AnalysisResult& result, const std::function<void(const std::vector<CoincidenceEvent>&)>& on_events = {})->bool;
+
+private:
+	struct Chunk {
+		std::size_t first_block{};
+		std::size_t last_block{}; // one past
+		std::int64_t begin_ps{};
+		std::int64_t end_ps{};
+	};
+
+	void analyse(const std::string& file, const std::vector<BlockIndex>& blocks, const Chunk& chunk, AnalysisResult& result, std::vector<CoincidenceEvent>& events) const;
+	[[nodiscard]] auto empty_result() const->AnalysisResult;
+
+	Settings m_settings{};
+	Timing m_timing{};
+	std::int64_t m_margin_ps{};
+	std::int64_t m_range_ps{}; // the interval histograms cover -range...range
+};
+
+#endif // ANALYSIS_H
@@ -0,0 +1,66 @@
+#ifndef BATCHING_H
+#define BATCHING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// chooses how many hits the processing takes at once and how often it runs at the latest.
+// larger batches amortise sorting and the coincidence search, but every hit waits until its batch is full.
+// the batch size is the largest one which can be filled and processed within the latency target at the
+// observed rate and processing cost per hit, corrected by the latencies actually observed.
+// the flush period bounds the latency at low rates, where batches do not fill up. the coincidence search
+// keeps back the newest hits until later ones arrive, after a flush period without new hits it closes
+// their windows, so they wait at most about two periods.
+// if the processing cannot keep up at all, the controller falls back to the largest batches.
+class BatchController {
+public:
+	struct Settings {
+		std::chrono::milliseconds latency_target{ 100 }; // from a hit entering the queue until its coincidences are written to the sinks, the time kept back by the coincidence search included
+		std::size_t min_batch{ 64 };
+		std::size_t max_batch{ std::size_t{ 1 } << 18U };
+		std::chrono::milliseconds min_period{ 1 };
+	};
+
+	struct Stats {
+		std::uint64_t batches{};
+		std::uint64_t hits{};
+		std::chrono::nanoseconds mean_latency{};
+		std::chrono::nanoseconds max_latency{};
+		std::size_t batch_size{};
+		std::chrono::nanoseconds period{};
+	};
+
+	explicit BatchController(Settings settings);
+
+	// called after every processed batch, with the time since the oldest hit whose coincidences were
+	// written entered the queue, and the time the processing took. hits is 0 if only kept back hits
+	// were released. returns true if the flush period changed.
+	auto update(std::size_t hits, std::chrono::nanoseconds latency, std::chrono::nanoseconds processing)->bool;
+
+	// thread safe, used by the acquisition thread to decide when to wake up the processing
+	[[nodiscard]] auto batch_size() const->std::size_t {
+		return m_batch_size.load(std::memory_order_relaxed);
+	}
+	[[nodiscard]] auto period() const->std::chrono::nanoseconds;
+	// statistics since the last call
+	[[nodiscard]] auto stats()->Stats;
+
+private:
+	Settings m_settings{};
+	std::atomic<std::size_t> m_batch_size{};
+	std::chrono::nanoseconds m_period{};
+	std::chrono::steady_clock::time_point m_last_update{};
+	double m_rate{}; // hits per second
+	double m_cost{}; // processing seconds per hit
+	double m_factor{ 0.5 }; // correction from the observed latencies
+	std::uint64_t m_batches{};
+	std::uint64_t m_hits{};
+	std::chrono::nanoseconds m_latency_sum{};
+	std::chrono::nanoseconds m_latency_max{};
+};
+
+auto operator<<(std::ostream& out, const BatchController::Stats& stats)->std::ostream&;
+
+#endif // BATCHING_H
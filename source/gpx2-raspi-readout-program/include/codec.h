@@ -0,0 +1,79 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "hit.h"
+#include "coincidence.h"
+#include <cstdint>
+#include <istream>
+#include <vector>
+
+// compressed block format for hit and coincidence streams.
+// a stream is a sequence of self contained blocks, every block starts with a fixed header:
+//  - hits: 2 bit channel numbers, zig-zag varint deltas of the extended ref_index per channel
+//    and stop_result bit-packed with the smallest width holding all values of the block
+//  - coincidences: zig-zag varint time delta to the previous one, group, channel mask and varint offsets
+// the payload is protected by a crc32, corrupt blocks are skipped by searching the next block magic.
+// time_ps is not stored, it has to be recalculated from the raw values with the calibration (see Timing).
+
+constexpr std::uint32_t block_magic { 0x42585047 }; // "GPXB" in little endian
+constexpr std::uint16_t block_version { 1 };
+
+struct BlockHeader {
+	std::uint32_t magic;
+	std::uint16_t version;
+	std::uint8_t stop_bits;
+	std::uint8_t reserved;
+	std::uint32_t hits;
+	std::uint32_t events;
+	std::uint32_t ref_bytes; // size of the ref_index delta section
+	std::uint32_t payload_size;
+	std::uint32_t checksum; // crc32 of the payload
+	std::uint32_t header_checksum; // crc32 of the header up to here
+	std::uint64_t ref_base[stop_channels]; // the ref_index deltas of each channel start from these values
+};
+static_assert(sizeof(BlockHeader) == 64, "block header layout changed");
+
+[[nodiscard]] auto crc32(const std::uint8_t* data, std::size_t size, std::uint32_t crc = 0)->std::uint32_t;
+
+// appends one block with the given hits and coincidences to out
+void encode_block(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events, std::vector<std::uint8_t>& out);
+
+enum class DecodeStatus {
+	Ok,
+	Incomplete, // more data needed
+	Corrupt // no valid block at the start of the data
+};
+
+// decodes the block at the start of data and appends its content to hits and events.
+// consumed is set to the size of the block, on Corrupt to the number of bytes which can be skipped safely.
+[[nodiscard]] auto decode_block(const std::uint8_t* data, std::size_t size, std::vector<Hit>& hits, std::vector<CoincidenceEvent>& events, std::size_t& consumed)->DecodeStatus;
+
+// position of one block in a recorded stream, found by reading the headers only
+struct BlockIndex {
+	std::uint64_t offset{};
+	std::uint64_t size{}; // header and payload
+	std::uint32_t hits{};
+	std::uint64_t first_ref{}; // smallest ref_index of the block
+};
+
+// lists all blocks with hits of a recorded stream without decoding them, returns the number of skipped bytes.
+// only the header checksums are checked, the payloads are checked when the blocks are decoded.
+auto index_blocks(std::istream& in, std::vector<BlockIndex>& blocks)->std::uint64_t;
+
+// reads all blocks of a recorded stream, resynchronising after corrupt data
+class BlockReader {
+public:
+	explicit BlockReader(std::istream& in);
+
+	// appends the content of the next block, false at the end of the stream
+	[[nodiscard]] auto next(std::vector<Hit>& hits, std::vector<CoincidenceEvent>& events)->bool;
+	[[nodiscard]] auto skipped_bytes() const->std::uint64_t;
+
+private:
+	std::istream& m_in;
+	std::vector<std::uint8_t> m_buffer{};
+	std::size_t m_pos{ 0 };
+	std::uint64_t m_skipped{ 0 };
+};
+
+#endif // CODEC_H
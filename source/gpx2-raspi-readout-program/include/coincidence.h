@@ -0,0 +1,105 @@
+#ifndef COINCIDENCE_H
+#define COINCIDENCE_H
+
+#include "hit.h"
+#include "radix_sort.h"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <limits>
+#include <vector>
+
+// set of stop channels which have to fire within a time window to count as coincidence
+struct CoincidenceGroup {
+	std::uint8_t channel_mask{}; // bit n set -> stop channel n takes part
+	std::uint8_t multiplicity{}; // number of different channels needed for an event
+	std::int64_t window_ps{}; // maximum time between first and last hit of an event
+	std::array<std::int64_t, stop_channels> delay_ps{}; // subtracted from the hit time of the channel before matching
+
+	// all given channels (numbered 1...4 like the STOP pins) have to fire, e.g. of({1,2}, 100e-9)
+	[[nodiscard]] static auto of(std::initializer_list<unsigned> stops, double window)->CoincidenceGroup;
+	// at least n of the given channels have to fire, e.g. any_of(2, {1,2,3,4}, 100e-9)
+	[[nodiscard]] static auto any_of(unsigned n, std::initializer_list<unsigned> stops, double window)->CoincidenceGroup;
+};
+
+// one coincidence found by the engine
+struct CoincidenceEvent {
+	std::int64_t time_ps{}; // time of the earliest participating hit (delay corrected)
+	std::array<std::int32_t, stop_channels> offset_ps{}; // hit time of each participating channel relative to time_ps
+	std::uint8_t group{}; // index of the group in the list given to the engine
+	std::uint8_t channel_mask{}; // participating channels
+};
+
+// evaluates all coincidence groups in a single pass over the time ordered hit stream of all channels.
+// hits may be handed over in arbitrary batches, hits newer than reorder_window before the newest hit
+// are kept back until the next call since hits of other channels may still arrive for them.
+// for the accidental coincidences every group can be evaluated a second time per delay in the same pass,
+// with the hits of all its channels but the lowest shifted later, the k-th further channel by k times the delay.
+// any two channels of the group are then at least the delay apart, so correlated hits do not match in any
+// combination of channels, also in groups which need only some of them. the events found in such a delayed
+// window are accidentals and are only counted.
+// a delay has to be longer than the window and all correlations between the channels.
+class CoincidenceEngine {
+public:
+	// events found in the delayed windows of a group with one delay
+	struct Accidentals {
+		std::size_t group{};
+		std::int64_t delay_ps{};
+		std::uint64_t count{};
+	};
+
+	CoincidenceEngine(std::vector<CoincidenceGroup> groups, std::int64_t reorder_window_ps = 1'000'000'000, std::vector<std::int64_t> accidental_delays_ps = {});
+
+	void process(std::vector<Hit>& hits, std::vector<CoincidenceEvent>& events, bool flush = false);
+
+	[[nodiscard]] auto groups() const->const std::vector<CoincidenceGroup>&;
+	// takes effect with the next hit, a window already open is closed by the new width
+	void set_window(std::size_t group, std::int64_t window_ps);
+	// windows have to be shorter than the time hits are kept back for the other channels
+	[[nodiscard]] auto max_window() const->std::int64_t;
+	[[nodiscard]] auto pending() const->std::size_t;
+	// events found per group
+	[[nodiscard]] auto counts() const->const std::vector<std::uint64_t>&;
+	// per group and delay, in the order of the groups
+	[[nodiscard]] auto accidentals() const->std::vector<Accidentals>;
+
+private:
+	struct Window {
+		std::array<std::int64_t, stop_channels> time_ps{};
+		std::uint8_t channel_mask{};
+		std::int64_t first_ps{ std::numeric_limits<std::int64_t>::max() };
+	};
+
+	struct Delayed {
+		std::size_t group{};
+		std::int64_t delay_ps{};
+		std::array<std::int64_t, stop_channels> shift_ps{}; // per channel, a multiple of the delay
+		Window window{};
+		std::array<std::deque<std::int64_t>, stop_channels> shifted{}; // shifted hit times, not matched yet
+		std::uint64_t count{};
+	};
+
+	void step(const Hit& hit, std::vector<CoincidenceEvent>& events);
+	// adds a hit to the window of a group, close is called with the window whenever it is done
+	template <typename Close>
+	void match(std::size_t group, Window& window, std::uint8_t channel, std::int64_t time_ps, Close&& close);
+	// matches the shifted hits up to until_ps in time order
+	template <typename Close>
+	void release(Delayed& delayed, std::int64_t until_ps, Close&& close);
+	void close(std::size_t group, std::vector<CoincidenceEvent>& events);
+	[[nodiscard]] auto complete(std::size_t group, const Window& window) const->bool;
+	void evict(Window& window, std::int64_t oldest_ps);
+
+	std::vector<CoincidenceGroup> m_groups{};
+	std::vector<std::int64_t> m_max_delay_ps{};
+	std::vector<Window> m_windows{};
+	std::vector<std::uint64_t> m_counts{};
+	std::vector<Delayed> m_delayed{};
+	std::vector<Hit> m_pending{};
+	std::vector<Hit> m_merged{};
+	HitSorter m_sorter{};
+	std::int64_t m_reorder_window_ps{};
+};
+
+#endif // COINCIDENCE_H
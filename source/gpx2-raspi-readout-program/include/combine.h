@@ -0,0 +1,61 @@
+#ifndef COMBINE_H
+#define COMBINE_H
+
+#include "hit.h"
+#include "coincidence.h"
+#include "radix_sort.h"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// decodes the results of the channel combine modes of the gpx2, in which the chip measures
+// two edges of one input with the two channels of a pair (stop 1 with channels 1 and 2, stop 3 with 3 and 4):
+//  - pulse distance: consecutive pulses alternate between the two channels
+//  - pulse width: the rising edge goes to the first, the falling edge to the second channel
+// the hits of a batch are sorted by time first, then the oldest waiting edge of the first channel of a pair
+// is paired with the oldest waiting edge of the second one. the pairs are turned into coincidence events
+// directly, no coincidence search is needed. a result without a plausible partner (second edge before the
+// first one or too far after it, e.g. after a fifo overflow) is discarded, which resynchronises the pairing.
+class ChannelCombiner {
+public:
+	enum class Mode {
+		Off, // every channel is an independent stop, the pairing is done by the coincidence engine
+		PulseDistance,
+		PulseWidth
+	};
+
+	struct Counters {
+		std::uint64_t pairs{};
+		std::uint64_t unpaired{}; // discarded results
+	};
+
+	static constexpr std::size_t channel_pairs{ stop_channels / 2 };
+
+	// max_interval_ps is the longest plausible interval between the two edges of a pair
+	ChannelCombiner(Mode mode, std::int64_t max_interval_ps);
+
+	// hits of a batch in any order, sorted by time on return. one event per pair is appended,
+	// its group is the index of the channel pair, the offset of the second channel is the interval.
+	// with flush, results still waiting for their partner are discarded
+	void process(std::vector<Hit>& hits, std::vector<CoincidenceEvent>& events, bool flush = false);
+
+	[[nodiscard]] auto mode() const->Mode;
+	[[nodiscard]] auto counters() const->const Counters&;
+	// results waiting for their partner
+	[[nodiscard]] auto pending() const->std::size_t;
+
+	// value of the CHANNEL_COMBINE register for the mode
+	[[nodiscard]] static auto register_value(Mode mode)->std::uint8_t;
+	[[nodiscard]] static auto parse_mode(const std::string& name, Mode& mode)->bool;
+
+private:
+	Mode m_mode{};
+	std::int64_t m_max_interval_ps{};
+	std::array<std::array<std::deque<std::int64_t>, 2>, channel_pairs> m_waiting{}; // times of unpaired results per channel
+	HitSorter m_sorter{};
+	Counters m_counters{};
+};
+
+#endif // COMBINE_H
@@ -0,0 +1,81 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "hit.h"
+#include "reactor.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// settings of the readout which can be changed while it runs, see ControlSocket
+struct RuntimeConfig {
+	static constexpr std::uint8_t all_stops{ (1U << stop_channels) - 1U };
+
+	std::vector<std::int64_t> window_ps{}; // per coincidence group
+	std::uint8_t stop_mask{ all_stops }; // enabled stop channels, bit n -> channel n
+	bool text_output{ true };
+};
+
+// current value of a configuration read by several threads (read copy update). a reader takes a snapshot
+// which stays valid and unchanged as long as it is held, the writer publishes a changed copy.
+// version() is cheap, so readers only take a new snapshot when it changed. one writer thread only.
+template <typename T>
+class Published {
+public:
+	explicit Published(T value)
+		: m_value{ std::make_shared<const T>(std::move(value)) }
+	{
+	}
+
+	[[nodiscard]] auto load() const->std::shared_ptr<const T> {
+		return std::atomic_load_explicit(&m_value, std::memory_order_acquire);
+	}
+
+	[[nodiscard]] auto version() const->std::uint64_t {
+		return m_version.load(std::memory_order_acquire);
+	}
+
+	void publish(T value) {
+		std::atomic_store_explicit(&m_value, std::shared_ptr<const T>{ std::make_shared<const T>(std::move(value)) }, std::memory_order_release);
+		m_version.fetch_add(1, std::memory_order_acq_rel);
+	}
+
+private:
+	std::shared_ptr<const T> m_value{};
+	std::atomic<std::uint64_t> m_version{ 0 };
+};
+
+// line based control interface on a unix domain socket, e.g. `socat - UNIX-CONNECT:path`.
+// every received line is handed to the handler in the reactor thread and its answer is sent back as one line.
+class ControlSocket {
+public:
+	using handler = std::function<std::string(const std::string& command)>;
+
+	ControlSocket(Reactor& reactor, handler h);
+	~ControlSocket();
+	ControlSocket(const ControlSocket&) = delete;
+	auto operator=(const ControlSocket&)->ControlSocket& = delete;
+
+	// a stale socket file at path is replaced, the file is removed again on destruction
+	[[nodiscard]] auto open(const std::string& path)->bool;
+
+private:
+	void accept();
+	void receive(int fd);
+	void drop(int fd);
+
+	static constexpr std::size_t max_clients{ 4 };
+	static constexpr std::size_t max_line{ 1024 };
+
+	Reactor& m_reactor;
+	handler m_handler{};
+	std::string m_path{};
+	int m_listen_fd{ -1 };
+	std::map<int, std::string> m_clients{}; // incomplete line per client
+};
+
+#endif // CONTROL_H
@@ -0,0 +1,94 @@
+#ifndef CORRELATOR_H
+#define CORRELATOR_H
+
+#include "hit.h"
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// streaming multi-tau correlator of the hits of two stop channels, g2(tau) over many decades of tau.
+// the hits are counted in bins on levels of doubling width (bin_ps * 2^level). every level keeps the counts
+// of the last `lags` bins of each channel. when a bin is complete, its count is multiplied with the counts of
+// the other channel 1 ... lags-1 bins before and then added to the bin of the next level. level 0 covers the
+// lags 0 ... lags-1 bins, the further levels lags/2 ... lags-1 bins of their width, so there are lags/2
+// points per doubling of tau. empty bins cost nothing, the work per hit mostly comes from the levels with
+// bins shorter than the mean distance between hits.
+// the products and counts are integers, so the correlators of several chips or runs merge exactly.
+class Correlator {
+public:
+	struct Settings {
+		std::uint8_t channel_a{ 0 }; // tau is the time of the hit of b minus the time of the hit of a
+		std::uint8_t channel_b{ 1 };
+		std::int64_t bin_ps{ 100 };
+		std::size_t lags{ 16 }; // per level, even
+		std::size_t levels{ 32 }; // the longest tau is bin_ps * lags * 2^(levels - 1)
+		std::int64_t reorder_window_ps{ 1'000'000'000 };
+	};
+
+	struct Point {
+		std::int64_t lag_ps{};
+		std::uint64_t products{};
+		double g2{};
+	};
+
+	explicit Correlator(Settings settings);
+
+	// hits of a batch sorted by time, other channels are ignored. hits newer than reorder_window before
+	// the newest hit are kept back until the next call since hits of the other channel may still arrive for them
+	void add(const std::vector<Hit>& hits);
+	// processes the hits kept back, at the end of a run
+	void flush();
+
+	// from the most negative to the most positive tau, g2 is 0 where nothing was measured yet
+	[[nodiscard]] auto curve() const->std::vector<Point>;
+	[[nodiscard]] auto settings() const->const Settings&;
+	// false if the settings differ
+	[[nodiscard]] auto merge(const Correlator& other)->bool;
+
+	// a header line and one line "lag_ps products g2" per point
+	void save(std::ostream& out) const;
+	// reads the next correlator written by save, false at the end or on a format error
+	[[nodiscard]] static auto load(std::istream& in, Correlator& correlator)->bool;
+
+private:
+	struct Bin {
+		std::int64_t index{};
+		std::uint64_t count{}; // 0: no bin
+	};
+
+	// the last closed bins of a channel, oldest first
+	struct History {
+		std::vector<Bin> bins{};
+		std::size_t head{ 0 };
+		std::size_t size{ 0 };
+	};
+
+	struct Level {
+		std::int64_t stream{}; // bin of the newest hit
+		std::array<Bin, 2> current{};
+		std::array<History, 2> history{};
+		std::vector<std::uint64_t> positive{}; // per lag, b after a
+		std::vector<std::uint64_t> negative{}; // per lag, b before a
+	};
+
+	void step(const Hit& hit);
+	void close_bins(std::size_t level, std::int64_t stream);
+	void close(std::size_t level, std::size_t channel);
+	[[nodiscard]] auto first_lag(std::size_t level) const->std::size_t;
+	[[nodiscard]] auto duration_ps() const->std::int64_t;
+	[[nodiscard]] auto g2(std::size_t level, std::size_t lag, std::uint64_t products) const->double;
+
+	Settings m_settings{};
+	std::vector<Level> m_levels{};
+	std::array<std::uint64_t, 2> m_hits{};
+	bool m_started{ false };
+	std::int64_t m_first_ps{};
+	std::int64_t m_last_ps{};
+	std::int64_t m_merged_duration_ps{ 0 }; // of merged or loaded correlators
+	std::vector<Hit> m_pending{};
+	std::vector<Hit> m_merged{};
+};
+
+#endif // CORRELATOR_H
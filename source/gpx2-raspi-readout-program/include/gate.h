@@ -0,0 +1,89 @@
+#ifndef GATE_H
+#define GATE_H
+
+#include "gpio.h"
+#include "hit.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// discards hits outside of gate windows (or inside of veto windows) directly after decoding,
+// so they cost neither queue memory nor coincidence search. the windows come either from a periodic
+// schedule on the time line of the hits or from the level of a gpio pin.
+// gpio edges are stamped with the host clock. they are moved onto the time line of the hits with an offset
+// estimated from the drains: a drain starting at host time T only returns hits measured before T, so the
+// smallest T - newest hit time seen recently is the closest estimate. its accuracy is the readout latency,
+// so windows from a pin should be long compared to it or be widened with margin_ps.
+class HitGate {
+public:
+	enum class Mode {
+		Off,
+		Gate, // only hits inside the windows pass
+		Veto // hits inside the windows are discarded
+	};
+
+	struct Schedule {
+		std::int64_t period_ps{};
+		std::int64_t offset_ps{}; // start of a window on the time line of the hits
+		std::int64_t width_ps{};
+	};
+
+	struct Settings {
+		Mode mode{ Mode::Off };
+		int pin{ -1 }; // the window is open while the pin is high (low with active_low), the schedule is used if negative
+		bool active_low{ false };
+		Schedule schedule{};
+		std::int64_t margin_ps{ 0 }; // both ends of every window are moved outwards by this
+	};
+
+	// read from other threads
+	struct Counters {
+		std::atomic<std::uint64_t> passed{ 0 };
+		std::atomic<std::uint64_t> discarded{ 0 };
+		std::atomic<std::uint64_t> edges{ 0 };
+	};
+
+	explicit HitGate(Settings settings);
+
+	[[nodiscard]] auto enabled() const->bool;
+	[[nodiscard]] auto uses_pin() const->bool;
+	// level of the pin before the first edge
+	void set_level(bool high);
+	// edges of the pin in the order they occurred, the vector is cleared
+	void add_edges(std::vector<gpio::event>& edges);
+	// drain_start is the time the hits were read, the hits need their time_ps
+	void apply(std::vector<Hit>& hits, std::chrono::steady_clock::time_point drain_start);
+	[[nodiscard]] auto counters() const->const Counters&;
+
+	[[nodiscard]] static auto parse_mode(const std::string& name, Mode& mode)->bool;
+	// "period,offset,width" in nano seconds
+	[[nodiscard]] static auto parse_schedule(const std::string& text, Schedule& schedule)->bool;
+
+private:
+	struct Transition {
+		std::int64_t time{}; // ns of the host clock until the offset is known, then ps of the hits
+		bool active{};
+	};
+
+	void update_offset(const std::vector<Hit>& hits, std::int64_t drain_ns);
+	[[nodiscard]] auto active_near(std::int64_t time_ps) const->bool;
+
+	Settings m_settings{};
+	bool m_base_active{ false }; // before the first transition
+	std::vector<Transition> m_new_edges{}; // host time
+	std::deque<Transition> m_transitions{}; // hit time
+	// smallest offset between host clock and hit time line of the current and the last second
+	std::int64_t m_offset_ps{ 0 };
+	std::int64_t m_block_offset_ps{ 0 };
+	std::int64_t m_previous_block_offset_ps{ 0 };
+	std::int64_t m_block_start_ns{ 0 };
+	bool m_offset_known{ false };
+	Counters m_counters{};
+};
+
+auto operator<<(std::ostream& out, const HitGate::Counters& counters)->std::ostream&;
+
+#endif // GATE_H
@@ -0,0 +1,126 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "hit.h"
+#include "gpx2.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// small and fast random number generator (xoshiro256**), the distributions are implemented here as well,
+// so a seed gives the same sequence with every compiler and standard library
+class Random {
+public:
+	explicit Random(std::uint64_t seed = 1);
+
+	auto next()->std::uint64_t {
+		const std::uint64_t result{ rotl(m_s[1] * 5U, 7) * 9U };
+		const std::uint64_t t{ m_s[1] << 17U };
+		m_s[2] ^= m_s[0];
+		m_s[3] ^= m_s[1];
+		m_s[1] ^= m_s[2];
+		m_s[0] ^= m_s[3];
+		m_s[2] ^= t;
+		m_s[3] = rotl(m_s[3], 45);
+		return result;
+	}
+	// uniform in (0, 1]
+	auto uniform()->double {
+		return static_cast<double>((next() >> 11U) + 1U) * 0x1.0p-53;
+	}
+	auto exponential(double mean)->double;
+	auto normal(double sigma)->double;
+
+private:
+	static constexpr auto rotl(std::uint64_t x, int k)->std::uint64_t {
+		return (x << k) | (x >> (64 - k));
+	}
+	std::array<std::uint64_t, 4> m_s{};
+	double m_spare{};
+	bool m_has_spare{ false };
+};
+
+// seeded generator of synthetic gpx2 hits for load tests: uncorrelated background per channel,
+// correlated start/stop pairs and bursts, each a poisson process of its own.
+// the hits are produced in time order, either in the raw form of GPX2::read_results() or directly as Hit.
+class HitGenerator {
+public:
+	enum class Interval {
+		Fixed, // delay_ps
+		Uniform, // delay_ps ... delay_ps + spread_ps
+		Exponential // delay_ps + exponential with mean spread_ps, e.g. a decay
+	};
+
+	struct Pair {
+		std::uint8_t start{ 0 }; // channel 0...3
+		std::uint8_t stop{ 1 };
+		double rate_hz{};
+		Interval interval{ Interval::Fixed };
+		double delay_ps{};
+		double spread_ps{};
+		double jitter_ps{}; // gaussian sigma added to the interval
+	};
+
+	struct Burst {
+		std::uint8_t channel{};
+		double rate_hz{}; // rate of the bursts
+		unsigned hits{}; // hits per burst
+		double spacing_ps{}; // mean distance of the hits in a burst
+	};
+
+	struct Settings {
+		std::uint64_t seed{ 1 };
+		std::int64_t refclk_period_ps{ 200000 };
+		std::uint32_t refclk_divisions{ 200000 };
+		unsigned ref_index_bits{ 24 };
+		std::int64_t dead_time_ps{ 5000 }; // hits of one channel closer than this are lost, like on the chip
+		std::array<double, stop_channels> background_hz{};
+		std::vector<Pair> pairs{};
+		std::vector<Burst> bursts{};
+	};
+
+	explicit HitGenerator(Settings settings);
+
+	// append all hits of the next duration_ps
+	void generate(std::int64_t duration_ps, std::vector<Hit>& hits);
+	void generate(std::int64_t duration_ps, std::vector<SPI::GPX2_TDC::Meas>& measurements);
+
+	[[nodiscard]] auto now_ps() const->std::int64_t;
+	[[nodiscard]] auto generated() const->std::uint64_t;
+	[[nodiscard]] auto lost_to_dead_time() const->std::uint64_t;
+
+private:
+	struct Emission {
+		std::int64_t time_ps{};
+		std::uint8_t channel{};
+	};
+
+	struct Process {
+		enum class Kind {
+			Background,
+			Pair,
+			Burst
+		} kind{};
+		std::size_t index{}; // channel, pair or burst
+		double mean_ps{}; // mean distance of the events
+		std::int64_t next_ps{};
+	};
+
+	void advance(std::int64_t end_ps);
+	void emit(const Process& process, std::int64_t time_ps);
+	[[nodiscard]] auto interval(const Pair& pair)->std::int64_t;
+
+	Settings m_settings{};
+	Random m_random;
+	std::vector<Process> m_processes{};
+	std::vector<Emission> m_pending{}; // generated, but later than the current end
+	std::vector<Emission> m_ready{};
+	std::array<std::int64_t, stop_channels> m_last_ps{};
+	std::int64_t m_now_ps{};
+	std::uint64_t m_generated{};
+	std::uint64_t m_dead{};
+	std::chrono::time_point<std::chrono::system_clock> m_epoch{};
+};
+
+#endif // GENERATOR_H
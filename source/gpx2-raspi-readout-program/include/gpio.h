@@ -1,12 +1,16 @@
 #ifndef GPIO_H
 #define GPIO_H
+#include "ring_buffer.h"
+#include "reactor.h"
 #include <vector>
+#include <array>
+#include <atomic>
 #include <mutex>
-#include <shared_mutex>
 #include <chrono>
 #include <future>
 #include <map>
 #include <memory>
+#include <condition_variable>
 #include <linux/gpio.h>
 #include <gpiod.h>
 
@@ -55,8 +59,15 @@ public:
     {
         friend class gpio;
     public:
-        [[nodiscard]] auto wait_async(std::chrono::milliseconds timeout)->std::future<event>;
-        [[nodiscard]] auto wait(std::chrono::milliseconds timeout)->event;
+        constexpr static std::size_t queue_size{ 1024 };
+
+        [[nodiscard]] auto wait_async(std::chrono::milliseconds timeout)->std::future<std::vector<event>>;
+        // returns all events queued since the last call, waits up to timeout if there are none
+        [[nodiscard]] auto wait(std::chrono::milliseconds timeout)->std::vector<event>;
+        // same as above but appends to events, so the caller can reuse the vector. returns number of new events
+        auto wait(std::chrono::milliseconds timeout, std::vector<event>& events)->std::size_t;
+        // number of events lost since the queue was full
+        [[nodiscard]] auto dropped() const -> std::uint64_t;
 
         [[nodiscard]] auto write_async(const event& e)->std::future<bool>;
         [[nodiscard]] auto write(const event& e) -> bool;
@@ -68,10 +79,10 @@ public:
         void notify(const event& e);
 
         setting m_setting{};
-        event m_event {};
+        RingBuffer<event> m_events{ queue_size };
+        std::atomic<bool> m_waiting{ false };
         std::condition_variable m_wait{};
         std::mutex m_wait_mutex{};
-        std::shared_mutex m_access_mutex{};
         gpio& m_handler;
     };
 
@@ -81,7 +92,11 @@ public:
     {};
     virtual ~gpio();
 
+    // runs the event loop in a thread of its own
     void start();
+    // instead of start(): requests the lines and dispatches their events from the reactor's thread.
+    // stop() or the destructor release the lines again.
+    [[nodiscard]] auto attach(Reactor& reactor) -> int;
 
     void stop();
 
@@ -93,6 +108,7 @@ public:
 private:
     [[nodiscard]] auto setup() -> int;
     [[nodiscard]] auto step() -> int;
+    [[nodiscard]] auto read_line_events(gpiod_line* line) -> int;
     [[nodiscard]] auto shutdown() -> int;
     [[nodiscard]] auto write(const event& e) -> bool;
     [[nodiscard]] auto read(unsigned pin_num) -> int;
@@ -104,19 +120,26 @@ private:
 
     const timespec c_wait_timeout{1,0};
 
+    constexpr static std::size_t event_read_size{ 16 };
+
     //std::shared_ptr<::gpiod_chip> chip{nullptr};
-    //std::shared_ptr<::gpiod_line_bulk> lines{nullptr};
     gpiod_chip* chip{nullptr};
-    gpiod_line_bulk* lines{nullptr};
+    gpiod_line_bulk* lines{nullptr}; // points to m_line_storage while the lines are requested
+    gpiod_line_bulk m_line_storage{};
+    gpiod_line_bulk m_fired{};
+    std::array<gpiod_line_event, event_read_size> m_line_events{};
 
     std::map< unsigned, gpiod_line* > other_lines{}; // map of other initialized lines which are requested but have no active event listening going on
     std::vector<unsigned> pins_used_by_listeners{};
+    std::vector<std::vector<std::shared_ptr<callback>>> m_dispatch{}; // pin number -> callbacks listening on it
 
     //inline static std::size_t global_id_counter{ 0 };
     std::size_t global_id_counter{ 0 };
     std::map < std::size_t, std::shared_ptr<callback> >  m_callback{};
 
     std::future<int> m_result{};
+    Reactor* m_reactor{ nullptr };
+    std::vector<int> m_event_fds{};
 
     std::chrono::microseconds m_timeout{ 10 };
 
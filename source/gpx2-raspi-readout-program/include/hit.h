@@ -0,0 +1,42 @@
+#ifndef HIT_H
+#define HIT_H
+
+#include "gpx2.h"
+#include <cstdint>
+#include <chrono>
+
+constexpr std::size_t stop_channels { 4 };
+
+// compact representation of one stop event after decoding
+struct Hit {
+	std::int64_t time_ps{}; // calibrated time in pico seconds, filled in by Timing::apply
+	std::uint64_t ref_index{}; // reference index extended beyond the register width
+	std::uint32_t stop_result{};
+	std::uint8_t channel{}; // stop channel 0...3
+
+	auto operator < (const Hit& other) const -> bool {
+		return time_ps < other.time_ps;
+	}
+};
+
+// extends the ref_index of the chip (which wraps after 2^ref_index_bits reference periods) to 64 bits.
+// all channels share the same reference counter, so one instance is used for all of them.
+// the readout timestamp of the measurement is used to bridge gaps longer than one wrap period.
+class RefIndexUnwrapper {
+public:
+	RefIndexUnwrapper(double refclk_freq = 5e6, unsigned ref_index_bits = 24);
+
+	[[nodiscard]] auto extend(std::uint32_t ref_index, std::chrono::time_point<std::chrono::system_clock> ts)->std::uint64_t;
+
+private:
+	double m_refclk_freq{};
+	std::uint64_t m_wrap{};
+	std::uint64_t m_last{};
+	std::chrono::time_point<std::chrono::system_clock> m_last_ts{};
+	bool m_initialised{ false };
+};
+
+// copies the raw values of a measurement, the time has to be calculated with a Timing instance
+[[nodiscard]] auto to_hit(const SPI::GPX2_TDC::Meas& meas, std::uint64_t extended_ref_index)->Hit;
+
+#endif // HIT_H
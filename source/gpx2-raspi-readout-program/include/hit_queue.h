@@ -0,0 +1,72 @@
+#ifndef HIT_QUEUE_H
+#define HIT_QUEUE_H
+
+#include "hit.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// queue of hits between the acquisition thread and the processing with a fixed memory budget.
+// all memory is allocated up front as a pool of chunks of chunk_hits hits each, the queue is a ring
+// of chunk indices, so pushing and popping never allocate. when the pool is exhausted the overflow
+// policy decides what happens, every lost hit is counted.
+class HitQueue {
+public:
+	enum class Overflow {
+		Block, // the acquisition waits until the processing frees chunks, the chip fifos fill up meanwhile
+		DropOldest, // the oldest queued chunk is discarded, waits like Block while pop_all copies every chunk
+		DropNewest // the incoming hits are discarded
+	};
+
+	struct Settings {
+		std::size_t memory_budget{ std::size_t{ 64 } << 20U }; // bytes
+		std::size_t chunk_hits{ 4096 };
+		Overflow overflow{ Overflow::Block };
+	};
+
+	struct Counters {
+		std::atomic<std::uint64_t> dropped_oldest{}; // hits
+		std::atomic<std::uint64_t> dropped_newest{}; // hits
+		std::atomic<std::uint64_t> overflows{}; // number of pushes which found the pool exhausted
+		std::atomic<std::uint64_t> blocked_ns{};
+	};
+
+	explicit HitQueue(Settings settings);
+
+	// copies the hits into the queue, returns the number of queued hits afterwards.
+	// with Overflow::Block this waits until there is space or run is cleared.
+	auto push(const std::vector<Hit>& hits, const std::atomic<bool>& run)->std::size_t;
+	// appends all queued hits to out and returns the chunks to the pool, one consumer thread only.
+	// the chunks are taken out of the ring under the lock and copied without it, so push only waits for
+	// the two short bookkeeping steps. since is set to the time the oldest of them was queued.
+	auto pop_all(std::vector<Hit>& out, std::chrono::steady_clock::time_point& since)->std::size_t;
+
+	[[nodiscard]] auto size() const->std::size_t;
+	[[nodiscard]] auto capacity() const->std::size_t;
+	[[nodiscard]] auto counters() const->const Counters&;
+
+	[[nodiscard]] static auto parse_overflow(const std::string& name, Overflow& overflow)->bool;
+
+private:
+	[[nodiscard]] auto acquire_chunk(std::unique_lock<std::mutex>& lock, const std::atomic<bool>& run)->bool;
+
+	Settings m_settings{};
+	std::vector<Hit> m_storage{};
+	std::vector<std::size_t> m_fill{}; // hits in each chunk
+	std::vector<std::size_t> m_free{}; // stack of unused chunks
+	std::vector<std::size_t> m_ring{}; // queued chunks, the last one is being filled
+	std::vector<std::size_t> m_taken{}; // chunks being copied by pop_all, neither queued nor free
+	std::size_t m_head{ 0 };
+	std::size_t m_count{ 0 };
+	std::size_t m_size{ 0 };
+	std::chrono::steady_clock::time_point m_since{};
+	mutable std::mutex m_mutex{};
+	std::condition_variable m_space{};
+	Counters m_counters{};
+};
+
+#endif // HIT_QUEUE_H
@@ -0,0 +1,85 @@
+#ifndef LVDS_H
+#define LVDS_H
+
+#include "gpx2.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// hit source for the lvds outputs of the gpx2 (PIN_ENA_LVDS_OUT), sampled by an fpga and read from a file
+// descriptor: a uio or character device of the fpga, a pipe or a capture file.
+// the stream has one byte per sample, bits 0..3 are the SDO lines of stop 1..4, bits 4..7 their FRAME lines.
+// the fpga samples with both edges of LCLK, so every LCLK period is a pair of samples. with a single data
+// rate only one of them carries the bit, with LVS_DOUBLE_DATA_RATE both are bits in the order of the stream.
+// a rising edge of FRAME starts a result of ref_index_bits + stop_result_bits bits, msb first, the ref_index
+// before the stop result. a FRAME edge before all bits of a result arrived means the link lost bits, the
+// partial result is discarded and the decoding starts again with the new frame. a result cut off without a
+// following frame can not be told apart, it is completed with the idle bits. at least stop results of
+// max_stop_result or more are impossible and discarded.
+// with LVDS_TEST_PATTERN the chip sends a fixed word instead of results, the words are then compared to
+// it and counted instead of being decoded.
+class LvdsSource {
+public:
+	struct Settings {
+		std::string path{}; // "-" for stdin
+		unsigned ref_index_bits{ 16 }; // as configured with REF_INDEX_BITWIDTH
+		unsigned stop_result_bits{ 20 }; // as configured with STOP_DATA_BITWIDTH
+		bool ddr{ false }; // LVS_DOUBLE_DATA_RATE
+		bool sdr_second_sample{ false }; // with a single data rate the bit is in the second sample of a pair
+		std::uint32_t max_stop_result{ 0 }; // refclk divisions, results with a stop result of at least this are discarded. unchecked if 0
+		double sample_rate_hz{ 0. }; // samples per second of the stream, the measurements are stamped with the read time if 0
+		bool test_pattern{ false };
+		std::uint64_t pattern{ 0 }; // the expected test word, 0 for alternating ones and zeros starting with a one
+		std::size_t read_size{ std::size_t{ 1 } << 16U };
+	};
+
+	// read from other threads
+	struct Counters {
+		std::atomic<std::uint64_t> bytes{ 0 };
+		std::atomic<std::uint64_t> results{ 0 };
+		std::atomic<std::uint64_t> resyncs{ 0 }; // partial results discarded
+		std::atomic<std::uint64_t> implausible{ 0 };
+		std::atomic<std::uint64_t> pattern_words{ 0 };
+		std::atomic<std::uint64_t> pattern_errors{ 0 }; // test words which differ from the pattern
+		std::atomic<std::uint64_t> pattern_bit_errors{ 0 };
+	};
+
+	explicit LvdsSource(Settings settings);
+	~LvdsSource();
+	LvdsSource(const LvdsSource&) = delete;
+	auto operator=(const LvdsSource&)->LvdsSource& = delete;
+
+	[[nodiscard]] auto open()->bool;
+	// waits at most timeout for data and appends the decoded results.
+	// false at the end of the stream or on a read error
+	[[nodiscard]] auto read(std::vector<SPI::GPX2_TDC::Meas>& measurements, std::chrono::milliseconds timeout)->bool;
+	// decodes a part of the stream, the parts of one stream have to be passed in order
+	void decode(const std::uint8_t* data, std::size_t size, std::vector<SPI::GPX2_TDC::Meas>& measurements);
+	[[nodiscard]] auto counters() const->const Counters&;
+	[[nodiscard]] auto settings() const->const Settings&;
+
+private:
+	void sample(std::uint8_t value, std::vector<SPI::GPX2_TDC::Meas>& measurements);
+	void complete(unsigned channel, std::uint64_t word, std::vector<SPI::GPX2_TDC::Meas>& measurements);
+
+	Settings m_settings{};
+	unsigned m_word_bits{};
+	int m_fd{ -1 };
+	bool m_owns_fd{ false };
+	std::vector<std::uint8_t> m_buffer{};
+	std::uint64_t m_samples{ 0 }; // bytes of the stream so far, for the stream time and the pairs of samples
+	std::chrono::system_clock::time_point m_origin{}; // stream time of the first sample
+	std::chrono::system_clock::time_point m_read_time{};
+	std::uint8_t m_frames{ 0 }; // FRAME lines of the last sample
+	std::uint8_t m_active{ 0 }; // channels receiving a result
+	std::uint64_t m_words[4]{};
+	unsigned m_bits[4]{};
+	Counters m_counters{};
+};
+
+auto operator<<(std::ostream& out, const LvdsSource::Counters& counters)->std::ostream&;
+
+#endif // LVDS_H
@@ -0,0 +1,100 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include "hit.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+
+// health of the acquisition: per channel rates, readout duty cycle, dead time and signs of lost data.
+// the acquisition thread only increments relaxed atomic counters, everything else is calculated
+// in sample() which is called periodically from another thread.
+class Monitor {
+public:
+	struct Counters {
+		std::array<std::atomic<std::uint64_t>, stop_channels> hits{};
+		std::atomic<std::uint64_t> drains{}; // readout rounds of the fifos
+		std::atomic<std::uint64_t> busy_ns{}; // time spent reading the chip
+		std::atomic<std::uint64_t> dead_ns{}; // time the readout lagged behind, the fifo may have overflown
+		std::atomic<std::uint64_t> interrupt_backlog{}; // interrupt pin still asserted after a drain
+		std::atomic<std::uint64_t> ref_gaps{}; // implausible jumps of the ref_index of a channel
+		std::atomic<std::uint64_t> queue_saturated{}; // hit queue memory budget exhausted
+	};
+
+	struct Sample {
+		std::chrono::steady_clock::time_point time{};
+		std::array<double, stop_channels> rate{}; // hits/s over the sliding window
+		double duty_cycle{}; // fraction of the window spent reading the chip
+		double dead_time{}; // fraction of the window the readout lagged behind the chip
+		std::uint64_t interrupt_backlog{};
+		std::uint64_t ref_gaps{};
+		std::uint64_t queue_saturated{};
+	};
+
+	// the rates are averaged over the last window samples
+	explicit Monitor(std::size_t window = 10);
+
+	[[nodiscard]] auto counters()->Counters&;
+
+	// counts the hit and checks its ref_index against the usual spacing of the channel, acquisition thread only
+	void count(const Hit& hit) {
+		m_counters.hits[hit.channel].fetch_add(1U, std::memory_order_relaxed);
+		auto& gap{ m_gap[hit.channel] };
+		if (!gap.started) {
+			// there is no spacing before the first hit of a channel
+			gap.started = true;
+			gap.last_ref = hit.ref_index;
+			return;
+		}
+		const auto delta{ static_cast<std::int64_t>(hit.ref_index - gap.last_ref) };
+		gap.last_ref = hit.ref_index;
+		if (gap.hits < gap_learn_hits) {
+			gap.hits++;
+			gap.mean_fp += ((delta << gap_fp_bits) - gap.mean_fp) / static_cast<std::int64_t>(gap.hits);
+			return;
+		}
+		if (delta < 0 || (delta << gap_fp_bits) > gap_factor * gap.mean_fp + (std::int64_t{ 1 } << gap_fp_bits)) {
+			m_counters.ref_gaps.fetch_add(1U, std::memory_order_relaxed);
+		}
+		gap.mean_fp += ((delta << gap_fp_bits) - gap.mean_fp) / gap_smoothing;
+	}
+
+	// takes a new sample from the counters, has to be called periodically from one thread
+	auto sample()->Sample;
+	[[nodiscard]] auto last() const->Sample;
+
+private:
+	static constexpr std::uint64_t gap_learn_hits{ 100 };
+	static constexpr std::int64_t gap_fp_bits{ 8 };
+	static constexpr std::int64_t gap_factor{ 50 };
+	static constexpr std::int64_t gap_smoothing{ 64 };
+
+	struct GapState {
+		bool started{ false };
+		std::uint64_t last_ref{};
+		std::uint64_t hits{}; // spacings learned
+		std::int64_t mean_fp{}; // mean ref_index spacing in fixed point
+	};
+
+	struct Snapshot {
+		std::chrono::steady_clock::time_point time{};
+		std::array<std::uint64_t, stop_channels> hits{};
+		std::uint64_t busy_ns{};
+		std::uint64_t dead_ns{};
+	};
+
+	Counters m_counters{};
+	std::array<GapState, stop_channels> m_gap{};
+	std::size_t m_window{};
+	std::deque<Snapshot> m_history{};
+	mutable std::mutex m_sample_mutex{};
+	Sample m_last{};
+};
+
+auto operator<<(std::ostream& out, const Monitor::Sample& sample)->std::ostream&;
+
+#endif // MONITOR_H
@@ -0,0 +1,88 @@
+#ifndef NET_SINK_H
+#define NET_SINK_H
+
+#include "sink.h"
+#include "net_stream.h"
+#include "reactor.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// serves hits and coincidences to any number of subscribers over tcp in the frame format of net_stream.h.
+// records are collected into a frame until it reaches max_frame_bytes or flush_interval passed, then
+// the frame is queued for every subscriber. all sockets are non blocking and handled by the reactor,
+// the send queue of each subscriber is bounded, so a slow subscriber loses frames instead of stalling
+// the processing. the subscribers see the lost frames as gaps in the sequence numbers.
+class NetSink : public Sink {
+public:
+	enum class Overflow {
+		DropOldest, // the oldest queued frames of the subscriber are discarded
+		DropNewest, // the new frame is not queued for the subscriber
+		Disconnect // the subscriber is disconnected
+	};
+
+	struct Settings {
+		std::string port{};
+		std::size_t max_frame_bytes{ 64U << 10U };
+		std::chrono::milliseconds flush_interval{ 100 };
+		std::size_t queue_bytes{ 4U << 20U }; // per subscriber
+		Overflow overflow{ Overflow::DropOldest };
+		std::size_t max_clients{ 8 };
+	};
+
+	struct Counters {
+		std::uint64_t frames{};
+		std::uint64_t bytes{};
+		std::uint64_t dropped_frames{}; // summed over the subscribers
+		std::uint64_t disconnects{}; // by the overflow policy
+		std::size_t clients{};
+	};
+
+	NetSink(Settings settings, Reactor& reactor);
+	~NetSink() override;
+	NetSink(const NetSink&) = delete;
+	auto operator=(const NetSink&)->NetSink& = delete;
+
+	// listens on all addresses
+	[[nodiscard]] auto open()->bool;
+	// the port listened on, the one chosen by the system for port 0
+	[[nodiscard]] auto port() const->std::string;
+	void write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) override;
+	void flush() override;
+	[[nodiscard]] auto counters() const->Counters;
+
+	[[nodiscard]] static auto parse_overflow(const std::string& name, Overflow& overflow)->bool;
+
+private:
+	using Frame = std::shared_ptr<const std::vector<std::uint8_t>>;
+
+	struct Client {
+		std::deque<Frame> queue{};
+		std::size_t queued_bytes{};
+		std::size_t sent{}; // of the first frame in the queue
+		bool want_write{ false };
+	};
+
+	void accept();
+	[[nodiscard]] auto pending_bytes() const->std::size_t;
+	void seal();
+	void enqueue(int fd, Client& client, const Frame& frame);
+	void send(int fd);
+	void drop(int fd);
+
+	Settings m_settings{};
+	Reactor& m_reactor;
+	int m_listen_fd{ -1 };
+	int m_timer_fd{ -1 };
+	std::map<int, Client> m_clients{};
+	std::vector<NetHitRecord> m_hits{};
+	std::vector<NetCoincidenceRecord> m_events{};
+	std::uint64_t m_sequence{ 0 };
+	Counters m_counters{};
+};
+
+#endif // NET_SINK_H
@@ -0,0 +1,75 @@
+#ifndef NET_STREAM_H
+#define NET_STREAM_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// wire format of the tcp stream the readout serves its hits and coincidences on (see NetSink).
+// the stream is a sequence of frames, each a header followed by the hit records and then the coincidence records.
+// all values are little endian. the frames are numbered, every subscriber gets the same numbers, so a gap
+// tells a subscriber how many frames were dropped for it because it did not read fast enough.
+// this header and net_stream.cpp form the receiver library, they do not depend on the rest of the program.
+
+constexpr std::uint32_t net_magic { 0x4e585047 }; // "GPXN" in little endian
+constexpr std::uint16_t net_version { 1 };
+
+struct NetFrameHeader {
+	std::uint32_t magic;
+	std::uint16_t version;
+	std::uint16_t header_size;
+	std::uint64_t sequence; // starts at 1
+	std::uint32_t hits;
+	std::uint32_t events;
+	std::uint32_t payload_size; // bytes of records following the header
+	std::uint32_t reserved;
+};
+static_assert(sizeof(NetFrameHeader) == 32, "frame header layout changed");
+
+struct NetHitRecord {
+	std::int64_t time_ps;
+	std::uint64_t ref_index;
+	std::uint32_t stop_result;
+	std::uint8_t channel;
+	std::uint8_t reserved[3];
+};
+static_assert(sizeof(NetHitRecord) == 24, "hit record layout changed");
+
+struct NetCoincidenceRecord {
+	std::int64_t time_ps;
+	std::int32_t offset_ps[4];
+	std::uint8_t group;
+	std::uint8_t channel_mask;
+	std::uint8_t reserved[6];
+};
+static_assert(sizeof(NetCoincidenceRecord) == 32, "coincidence record layout changed");
+
+// subscribes to the stream of a readout
+class NetReceiver {
+public:
+	NetReceiver() = default;
+	~NetReceiver();
+	NetReceiver(const NetReceiver&) = delete;
+	auto operator=(const NetReceiver&)->NetReceiver& = delete;
+
+	[[nodiscard]] auto connect(const std::string& host, const std::string& port)->bool;
+	void close();
+	// blocks until the next frame arrived and appends its records.
+	// false if the connection was closed, the stream is corrupt or a signal interrupted the wait
+	[[nodiscard]] auto next(std::vector<NetHitRecord>& hits, std::vector<NetCoincidenceRecord>& events)->bool;
+
+	[[nodiscard]] auto frames() const->std::uint64_t;
+	// frames dropped by the readout for this subscriber, from the gaps in the sequence numbers
+	[[nodiscard]] auto lost_frames() const->std::uint64_t;
+
+private:
+	[[nodiscard]] auto read_exact(void* data, std::size_t size)->bool;
+
+	int m_fd{ -1 };
+	std::uint64_t m_last_sequence{ 0 };
+	std::uint64_t m_frames{ 0 };
+	std::uint64_t m_lost{ 0 };
+	std::vector<std::uint8_t> m_payload{};
+};
+
+#endif // NET_STREAM_H
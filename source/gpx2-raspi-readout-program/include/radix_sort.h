@@ -0,0 +1,54 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include "hit.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// stable lsd radix sort of hits with 8 bit digits.
+// the keys are extracted once into compact records of key and index, which are sorted instead of the hits,
+// and the hits are gathered in their new order at the end. passes over digits which are equal in all keys,
+// like the upper bytes of the times of one batch, are skipped, so a batch typically takes 3 to 5 passes.
+// small batches are left to std::stable_sort. the scratch buffers keep their capacity between calls.
+// with more than one thread, large batches are sorted by a partitioned variant with the same result:
+// every thread counts and scatters its own contiguous part of the input into its own part of each bucket.
+// the threads are started once per sort and meet at a barrier between the steps of a pass.
+class HitSorter {
+public:
+	enum class Key {
+		Time, // calibrated time_ps, the order of the coincidence engine
+		Raw // extended ref_index, then stop_result, for data before calibration
+	};
+
+	explicit HitSorter(Key key = Key::Time, unsigned threads = 1);
+
+	void sort(std::vector<Hit>& hits);
+
+	// below this size std::stable_sort is used
+	static constexpr std::size_t min_radix{ 256 };
+	// the partitioned variant is only used with at least this many hits per thread
+	static constexpr std::size_t min_per_thread{ std::size_t{ 1 } << 16U };
+
+private:
+	struct Record {
+		std::uint64_t high{}; // time_ps with flipped sign bit or extended ref_index
+		std::uint32_t low{}; // stop_result for Key::Raw
+		std::uint32_t index{};
+	};
+	static constexpr unsigned digits{ 11 }; // 3 digits of low, 8 of high
+	using Histogram = std::vector<std::array<std::size_t, 256>>;
+
+	[[nodiscard]] auto record(const Hit& hit, std::uint32_t index) const->Record;
+	void sort_records(std::size_t n);
+	void sort_records_parallel(std::size_t n, unsigned threads);
+
+	Key m_key{};
+	unsigned m_threads{};
+	std::vector<Record> m_records{};
+	std::vector<Record> m_scratch{};
+	std::vector<Hit> m_sorted{};
+	Histogram m_counts{};
+};
+
+#endif // RADIX_SORT_H
@@ -0,0 +1,65 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sys/epoll.h>
+
+// single threaded event loop based on epoll. file descriptors (e.g. gpio line events), timers (timerfd),
+// signals (signalfd) and wake ups from other threads (eventfd) are all dispatched from the thread calling run().
+class Reactor {
+public:
+	using handler = std::function<void(std::uint32_t epoll_events)>;
+
+	Reactor();
+	~Reactor();
+	Reactor(const Reactor&) = delete;
+	auto operator=(const Reactor&)->Reactor& = delete;
+
+	[[nodiscard]] auto add_fd(int fd, handler h, std::uint32_t epoll_events = EPOLLIN)->bool;
+	void remove_fd(int fd);
+	// changes the epoll events a fd added with add_fd is watched for
+	[[nodiscard]] auto modify_fd(int fd, std::uint32_t epoll_events)->bool;
+
+	// calls h every period, returns the timer fd or -1
+	[[nodiscard]] auto add_timer(std::chrono::nanoseconds period, std::function<void()> h)->int;
+	// changes the period of a timer returned by add_timer, the next expiry is one period from now
+	[[nodiscard]] static auto set_timer(int fd, std::chrono::nanoseconds period)->bool;
+	// blocks the signals for the calling thread and delivers them through a signalfd instead.
+	// has to be called before any other thread is started, since those inherit the signal mask.
+	[[nodiscard]] auto add_signals(std::initializer_list<int> signals, std::function<void(int)> h)->bool;
+	// returns an eventfd which runs h in the loop thread whenever notify(fd) is called from any thread
+	[[nodiscard]] auto add_event(std::function<void()> h)->int;
+	static void notify(int event_fd);
+
+	// removes and closes a fd returned by add_timer, add_event or add_signals
+	void close_fd(int fd);
+
+	auto run()->int;
+	// waits at most timeout for events and dispatches them, returns number of dispatched events or -1
+	auto step(std::chrono::milliseconds timeout)->int;
+	// thread safe, makes run() return
+	void stop();
+
+private:
+	struct Entry {
+		std::shared_ptr<handler> h{};
+		bool owned{ false }; // created by the reactor and closed with it
+	};
+
+	[[nodiscard]] auto add_owned_fd(int fd, handler h)->bool;
+
+	int m_epoll_fd{ -1 };
+	int m_stop_fd{ -1 };
+	std::atomic<bool> m_run{ true };
+	std::mutex m_handler_mutex{};
+	std::map<int, Entry> m_handlers{};
+};
+
+#endif // REACTOR_H
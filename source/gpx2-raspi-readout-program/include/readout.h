@@ -3,6 +3,25 @@
 
 #include "gpx2.h"
 #include "gpio.h"
+#include "hit.h"
+#include "coincidence.h"
+#include "combine.h"
+#include "timing.h"
+#include "reactor.h"
+#include "sink.h"
+#include "net_sink.h"
+#include "monitor.h"
+#include "wait_policy.h"
+#include "generator.h"
+#include "batching.h"
+#include "hit_queue.h"
+#include "spi_speed.h"
+#include "watchdog.h"
+#include "control.h"
+#include "gate.h"
+#include "lvds.h"
+#include <array>
+#include <vector>
 #include <future>
 #include <thread>
 #include <iostream>
@@ -21,35 +40,135 @@ inline static void print_hex(const std::string& str) {
 
 class Readout {
 public:
-	Readout(double max_ref_diff = 100e-9, unsigned interrupt_pin = 20);
+	struct Settings {
+		std::vector<CoincidenceGroup> groups{};
+		std::vector<std::int64_t> accidental_delays_ps{}; // delayed windows per group for the accidental coincidences, see CoincidenceEngine
+		unsigned interrupt_pin{ 20 };
+		std::string calibration_file{}; // calibration table to load, the nominal lsb is used if empty
+		std::string code_density_file{}; // if set, all hits are used to build the nonlinearity table which is written to this file
+		std::chrono::seconds stats_interval{ 60 }; // period of the rate summary on stderr, 0 to disable
+		std::chrono::milliseconds monitor_interval{ 1000 }; // period of the monitor samples
+		std::size_t monitor_window{ 10 }; // number of monitor samples the rates are averaged over
+		InterruptWait::Settings wait{}; // how the acquisition thread waits for the interrupt of the gpx2
+		HitQueue::Settings queue{}; // memory budget and overflow policy of the hit queue
+		BatchController::Settings batching{}; // latency target and limits of the processing batches
+		ChannelCombiner::Mode combine{ ChannelCombiner::Mode::Off }; // channel combine mode of the chip, the pairs then bypass the coincidence engine
+		bool combine_stop3{ true }; // with combine, whether the pair of stop 3 is used, otherwise only channels 1 and 2 are read
+		std::uint32_t spi_speed{ 0 }; // spi clock in Hz, 0 for the default of the library
+		bool spi_calibration{ false }; // find the fastest reliable spi clock and check it during operation
+		SpiSpeed::Settings spi{};
+		RegisterWatchdog::Settings watchdog{}; // periodic check and repair of the config registers while measuring
+		bool warm_attach{ false }; // keep a configured and measuring chip running, only differing registers are written
+		bool synthetic{ false }; // no hardware, hits are generated in real time with the generator settings
+		HitGenerator::Settings generator{};
+		LvdsSource::Settings lvds{}; // if a path is set, the results come from the lvds outputs of the gpx2 through an fpga
+		bool lvds_setup{ false }; // with lvds, also configure the gpx2 over spi for the lvds outputs
+		bool text_output{ true }; // coincidences as text on stdout
+		std::string g2_file{}; // if set, the g2 curves of the channel pairs of the groups are written to this file periodically
+		std::chrono::seconds g2_interval{ 10 };
+		std::int64_t g2_bin_ps{ 100 }; // width of the shortest lag bins
+		std::chrono::seconds statistics_interval{ 0 }; // if set, period of the interval and stop_result statistics on stderr
+		std::string shm_name{}; // if set, hits and coincidences are published in the shared memory ring of this name
+		std::size_t shm_capacity{ std::size_t{ 1 } << 20U };
+		std::string record_file{}; // if set, hits and coincidences are appended to this file in the block format of codec.h
+		NetSink::Settings net{}; // if a port is set, hits and coincidences are served to subscribers over tcp, see net_stream.h
+		HitGate::Settings gate{}; // gate or veto windows, hits outside of the gates are discarded before the queue
+		std::string control_socket{}; // if set, path of the unix socket for changes while running, see control_command
+	};
+
+	// the acquisition runs in a thread of its own, everything else (gpio edges, processing, statistics)
+	// is driven by the reactor, which has to run in another thread while the Readout exists
+	Readout(Settings settings, Reactor& reactor);
 	~Readout();
 
 	void stop();
+	// non zero if the setup or the acquisition failed, the end of an lvds capture is no failure
+	[[nodiscard]] auto exit_status() const->int;
 
 private:
+	// stops the program with a failure status
+	void fail();
 	[[nodiscard]] auto setup()->int;
 	[[nodiscard]] auto read_tdc()->int;
+	[[nodiscard]] auto set_spi_speed(const std::string& registers, bool measuring)->bool;
+	[[nodiscard]] auto maintain()->int;
+	void enable_stops(std::uint8_t mask);
+	[[nodiscard]] auto setup_synthetic()->int;
+	[[nodiscard]] auto read_synthetic()->int;
+	[[nodiscard]] auto setup_lvds()->int;
+	[[nodiscard]] auto read_lvds()->int;
+	void enqueue(std::vector<Hit>& hits, std::chrono::steady_clock::time_point drain_start);
 
-	[[nodiscard]] auto process_loop()->int;
-
-	void process_queue(bool ignore_max_queue = false);
+	void process_queue(bool flush = false);
+	// one command of the control socket, returns the answer
+	[[nodiscard]] auto control_command(const std::string& command)->std::string;
+	void print_stats();
+	void sample_monitor();
+	void print_statistics();
+	void print_accidentals();
 
 	std::unique_ptr<gpio> handler{};
 	std::shared_ptr<gpio::callback> callback{};
-	const std::chrono::milliseconds process_loop_timeout{ std::chrono::milliseconds(100) };
-	size_t max_queue_size{ 500 };
-	size_t min_queue_size{ 5 };
+	std::shared_ptr<gpio::callback> gate_callback{};
+	std::vector<gpio::event> gate_edges{};
+	std::unique_ptr<InterruptWait> interrupt_wait{};
+	InterruptWait::Metrics wait_metrics{};
 	const std::chrono::microseconds readout_loop_timeout{ std::chrono::microseconds(1) };
-	double m_max_interval{};
-	unsigned m_interrupt_pin{};
+	Settings m_settings{};
+	Reactor& m_reactor;
+	int flush_timer{ -1 };
+	int stats_timer{ -1 };
+	int monitor_timer{ -1 };
+	int statistics_timer{ -1 };
+	int g2_timer{ -1 };
+	int queue_full_event{ -1 }; // notified by the acquisition thread when the batch size is reached
 	std::chrono::time_point<std::chrono::high_resolution_clock> start_time{};
 	std::chrono::time_point<std::chrono::high_resolution_clock> end_time{};
-	std::condition_variable queue_condition;
-	std::array<std::queue<SPI::GPX2_TDC::Meas>,2> tdc_stop{};
+	std::chrono::time_point<std::chrono::high_resolution_clock> last_stats_time{};
+	std::uint64_t last_stats_count{};
+	std::chrono::steady_clock::time_point last_drain{};
+	Monitor monitor;
+	HitQueue tdc_stop;
+	// buffers reused for every drain and batch, so the steady state does not allocate
+	std::vector<Hit> drain_hits{};
+	std::vector<SPI::GPX2_TDC::Meas> synthetic_measurements{};
+	std::vector<SPI::GPX2_TDC::Meas> lvds_measurements{};
+	std::vector<Hit> batch{};
+	std::vector<CoincidenceEvent> batch_events{};
+	std::chrono::steady_clock::time_point held_since{}; // queue time of the oldest hit kept back by the coincidence search
+	BatchController batching;
+	RefIndexUnwrapper unwrapper{};
+	Timing timing{};
+	HitGate gate;
+	CoincidenceEngine coincidence;
+	// changed by the control socket in the reactor thread, taken over by the processing before a batch
+	// and by the acquisition thread between two drains
+	Published<RuntimeConfig> runtime;
+	std::unique_ptr<ControlSocket> control{};
+	std::uint64_t processing_version{ 0 };
+	std::shared_ptr<const RuntimeConfig> processing_config{};
+	std::uint64_t acquisition_version{ 0 };
+	std::uint8_t stop_mask{ RuntimeConfig::all_stops }; // of the acquisition thread
+	std::unique_ptr<ChannelCombiner> combiner{};
+	std::size_t read_channels{ stop_channels };
+	std::unique_ptr<CodeDensityCalibration> code_density{};
+	std::vector<std::unique_ptr<Sink>> sinks{};
+	TextSink* text{ nullptr }; // owned by sinks
+	StatisticsSink* statistics{ nullptr }; // owned by sinks
+	CorrelationSink* correlation{ nullptr }; // owned by sinks
+	NetSink* net{ nullptr }; // owned by sinks
 	std::unique_ptr<SPI::GPX2_TDC::GPX2> gpx2{};
+	std::unique_ptr<SpiSpeed> spi_speed{};
+	std::string chip_registers{}; // config registers the chip should hold while measuring
+	RegisterWatchdog watchdog;
+	std::unique_ptr<HitGenerator> generator{};
+	std::chrono::steady_clock::time_point generator_time{};
+	const std::chrono::milliseconds synthetic_period{ 1 };
+	std::unique_ptr<LvdsSource> lvds{};
+	const std::chrono::milliseconds lvds_timeout{ 10 };
 	std::atomic<uint64_t> evt_count{};
 	std::atomic<bool> m_run{ true };
-	std::thread gpio_thread;
-	std::thread analysis_thread;
+	std::atomic<int> m_exit_status{ 0 };
+	std::thread acquisition_thread;
 };
 #endif // READOUT_H
@@ -0,0 +1,88 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// lock-free ring buffer for exactly one producer and one consumer thread.
+// the capacity is rounded up to a power of two, values pushed while the ring is full are dropped and counted.
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(std::size_t capacity = 1024)
+    {
+        std::size_t size{ 1 };
+        while (size < capacity) {
+            size <<= 1U;
+        }
+        m_buffer.resize(size);
+        m_mask = size - 1U;
+    }
+
+    [[nodiscard]] auto push(const T& value) -> bool
+    {
+        const auto tail{ m_tail.load(std::memory_order_relaxed) };
+        if (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+            m_dropped.fetch_add(1U, std::memory_order_relaxed);
+            return false;
+        }
+        m_buffer[tail & m_mask] = value;
+        m_tail.store(tail + 1U, std::memory_order_seq_cst);
+        return true;
+    }
+
+    [[nodiscard]] auto pop(T& value) -> bool
+    {
+        const auto head{ m_head.load(std::memory_order_relaxed) };
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = m_buffer[head & m_mask];
+        m_head.store(head + 1U, std::memory_order_release);
+        return true;
+    }
+
+    // appends up to max values to out, returns the number of values taken
+    auto pop(std::vector<T>& out, std::size_t max) -> std::size_t
+    {
+        const auto head{ m_head.load(std::memory_order_relaxed) };
+        const auto tail{ m_tail.load(std::memory_order_acquire) };
+        std::size_t n{ 0 };
+        for (; n < max && head + n != tail; n++) {
+            out.push_back(m_buffer[(head + n) & m_mask]);
+        }
+        m_head.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    [[nodiscard]] auto empty() const -> bool
+    {
+        return m_head.load(std::memory_order_seq_cst) == m_tail.load(std::memory_order_seq_cst);
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] auto capacity() const -> std::size_t
+    {
+        return m_mask + 1U;
+    }
+
+    [[nodiscard]] auto dropped() const -> std::uint64_t
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<T> m_buffer{};
+    std::size_t m_mask{};
+    alignas(64) std::atomic<std::size_t> m_head{ 0 }; // only written by the consumer
+    alignas(64) std::atomic<std::size_t> m_tail{ 0 }; // only written by the producer
+    alignas(64) std::atomic<std::uint64_t> m_dropped{ 0 };
+};
+
+#endif // RING_BUFFER_H
@@ -0,0 +1,107 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// layout of the shared memory ring the readout publishes its hits and coincidences to.
+// one writer (the readout program), any number of readers in other processes. readers never block the writer:
+// every record carries its sequence number, so a reader which was overtaken notices it and skips ahead.
+// this header and shm_ring.cpp form the reader library, they do not depend on the rest of the program.
+
+constexpr std::uint32_t shm_magic { 0x47505832 }; // "GPX2"
+constexpr std::uint16_t shm_version { 1 };
+
+enum class ShmRecordType : std::uint8_t {
+	Invalid = 0,
+	Hit = 1,
+	Coincidence = 2
+};
+
+struct ShmHitRecord {
+	std::int64_t time_ps;
+	std::uint64_t ref_index;
+	std::uint32_t stop_result;
+	std::uint8_t channel;
+};
+
+struct ShmCoincidenceRecord {
+	std::int64_t time_ps;
+	std::int32_t offset_ps[4];
+	std::uint8_t group;
+	std::uint8_t channel_mask;
+};
+
+struct ShmRecord {
+	ShmRecordType type{ ShmRecordType::Invalid };
+	union {
+		ShmHitRecord hit;
+		ShmCoincidenceRecord coincidence;
+	};
+	ShmRecord() : hit{} {}
+};
+
+struct ShmSlot {
+	std::atomic<std::uint64_t> seq; // sequence number of the record in this slot, 0 while it is written
+	ShmRecord record;
+};
+
+struct ShmHeader {
+	std::atomic<std::uint32_t> magic; // written last by the writer, the layout is valid once it is set
+	std::uint16_t version;
+	std::uint16_t slot_size;
+	std::uint64_t capacity; // number of slots, power of two
+	alignas(64) std::atomic<std::uint64_t> write_seq; // sequence number of the last completely written record
+	std::atomic<std::uint32_t> closed; // set when the writer shut down
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared memory ring needs address free atomics");
+
+class ShmWriter {
+public:
+	ShmWriter() = default;
+	~ShmWriter();
+	ShmWriter(const ShmWriter&) = delete;
+	auto operator=(const ShmWriter&)->ShmWriter& = delete;
+
+	// creates (or replaces) the shared memory object /name, capacity is rounded up to a power of two
+	[[nodiscard]] auto open(const std::string& name, std::size_t capacity)->bool;
+	void write(const ShmRecord* records, std::size_t n);
+	[[nodiscard]] auto written() const->std::uint64_t;
+
+private:
+	std::string m_name{};
+	void* m_memory{ nullptr };
+	std::size_t m_size{};
+	ShmHeader* m_header{ nullptr };
+	ShmSlot* m_slots{ nullptr };
+	std::uint64_t m_seq{ 0 };
+};
+
+class ShmReader {
+public:
+	ShmReader() = default;
+	~ShmReader();
+	ShmReader(const ShmReader&) = delete;
+	auto operator=(const ShmReader&)->ShmReader& = delete;
+
+	// maps the ring read-only. reading starts with the next record written unless from_oldest is set
+	[[nodiscard]] auto open(const std::string& name, bool from_oldest = false)->bool;
+	// appends up to max new records to out and returns their number
+	auto read(std::vector<ShmRecord>& out, std::size_t max)->std::size_t;
+	// records which were overwritten before this reader got to them
+	[[nodiscard]] auto lost() const->std::uint64_t;
+	[[nodiscard]] auto writer_closed() const->bool;
+
+private:
+	void* m_memory{ nullptr };
+	std::size_t m_size{};
+	const ShmHeader* m_header{ nullptr };
+	const ShmSlot* m_slots{ nullptr };
+	std::uint64_t m_next{ 1 };
+	std::uint64_t m_lost{ 0 };
+};
+
+#endif // SHM_RING_H
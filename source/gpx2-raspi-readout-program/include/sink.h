@@ -0,0 +1,87 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include "hit.h"
+#include "coincidence.h"
+#include "correlator.h"
+#include "shm_ring.h"
+#include "statistics.h"
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// receives every processed batch of decoded hits and found coincidences
+class Sink {
+public:
+	virtual ~Sink() = default;
+	virtual void write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) = 0;
+	virtual void flush() {}
+};
+
+// one line per coincidence: time_ps group channel:offset_ps ...
+class TextSink : public Sink {
+public:
+	explicit TextSink(std::ostream& out);
+	void write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) override;
+	void flush() override;
+
+private:
+	std::ostream& m_out;
+};
+
+// publishes hits and coincidences into a shared memory ring, see shm_ring.h
+class ShmSink : public Sink {
+public:
+	ShmSink() = default;
+	[[nodiscard]] auto open(const std::string& name, std::size_t capacity)->bool;
+	void write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) override;
+
+private:
+	ShmWriter m_writer{};
+	std::vector<ShmRecord> m_records{};
+};
+
+// records hits and coincidences to a file in the compressed block format of codec.h
+class FileSink : public Sink {
+public:
+	FileSink() = default;
+	[[nodiscard]] auto open(const std::string& file)->bool;
+	void write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) override;
+	void flush() override;
+
+private:
+	std::ofstream m_out{};
+	std::vector<std::uint8_t> m_block{};
+};
+
+// keeps only running statistics of the intervals per channel pair and of the stop results, see statistics.h
+class StatisticsSink : public Sink {
+public:
+	void write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) override;
+
+	// statistics since the last snapshot, which are added to the total
+	[[nodiscard]] auto snapshot()->PairStatistics;
+	[[nodiscard]] auto total() const->PairStatistics;
+
+private:
+	PairStatistics m_current{};
+	PairStatistics m_total{};
+};
+
+// multi-tau correlation of channel pairs, see correlator.h
+class CorrelationSink : public Sink {
+public:
+	explicit CorrelationSink(const std::vector<Correlator::Settings>& pairs);
+	void write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) override;
+	void flush() override;
+
+	// writes the current curves of all pairs, the file is replaced at once so readers never see a partial one
+	[[nodiscard]] auto snapshot(const std::string& file) const->bool;
+
+private:
+	std::vector<Correlator> m_correlators{};
+};
+
+#endif // SINK_H
@@ -0,0 +1,50 @@
+#ifndef SPI_SPEED_H
+#define SPI_SPEED_H
+
+#include "gpx2.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// finds the fastest spi clock at which the link to the gpx2 works without errors.
+// the speeds of the ladder are tested from the slowest one up with the known answer test of GPX2::transfer_test
+// until one shows bit errors, then the speed margin_steps below the fastest error free one is selected.
+// the result is kept per board in a file, on the next start the stored speed only has to pass a short test.
+// during operation the speed is checked again with read only tests and lowered a step if errors show up.
+class SpiSpeed {
+public:
+	struct Settings {
+		std::string file{}; // "board speed_hz" per line, nothing is stored if empty
+		// the clock dividers of the raspberry pi: 250 MHz core clock divided by powers of two
+		std::vector<std::uint32_t> ladder{ 61'035, 122'070, 244'140, 488'281, 976'562, 1'953'125, 3'906'250, 7'812'500, 15'625'000, 31'250'000 };
+		unsigned transfers{ 500 }; // per speed of the calibration
+		unsigned margin_steps{ 1 };
+		unsigned check_transfers{ 32 }; // for the test of a stored speed and the periodic checks
+		std::chrono::seconds check_interval{ 60 };
+	};
+
+	explicit SpiSpeed(Settings settings);
+
+	// sets the speed of the gpx2, the stored one for this board if it passes the test or a newly calibrated one.
+	// registers are the current content of the config registers. if measuring, they are only read,
+	// otherwise test patterns are written as well. false if even the slowest speed does not work
+	[[nodiscard]] auto select(SPI::GPX2_TDC::GPX2& gpx2, const std::string& registers, bool measuring)->bool;
+	// read only check of the current speed, lowers it a step on errors. false if the slowest speed fails
+	[[nodiscard]] auto check(SPI::GPX2_TDC::GPX2& gpx2, const std::string& registers)->bool;
+	[[nodiscard]] auto check_due(std::chrono::steady_clock::time_point now) const->bool;
+
+	// serial number of the raspberry pi, the machine id on other systems
+	[[nodiscard]] static auto board_id()->std::string;
+
+private:
+	[[nodiscard]] auto calibrate(SPI::GPX2_TDC::GPX2& gpx2, const std::string& registers, bool measuring)->bool;
+	[[nodiscard]] auto load()->std::uint32_t;
+	void store(std::uint32_t speed);
+
+	Settings m_settings{};
+	std::string m_board{};
+	std::chrono::steady_clock::time_point m_next_check{};
+};
+
+#endif // SPI_SPEED_H
@@ -0,0 +1,62 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include "hit.h"
+#include "coincidence.h"
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+// running count, mean, variance, min and max in constant memory.
+// updates use welford's algorithm, merges the parallel variant of chan et al., both are numerically stable.
+struct RunningStats {
+	std::uint64_t count{ 0 };
+	double mean{ 0. };
+	double m2{ 0. }; // sum of squared deviations from the mean
+	double min{ std::numeric_limits<double>::infinity() };
+	double max{ -std::numeric_limits<double>::infinity() };
+
+	void add(double x) {
+		count++;
+		const double delta{ x - mean };
+		mean += delta / static_cast<double>(count);
+		m2 += delta * (x - mean);
+		min = x < min ? x : min;
+		max = x > max ? x : max;
+	}
+	void merge(const RunningStats& other);
+	[[nodiscard]] auto variance() const->double; // sample variance
+	[[nodiscard]] auto stddev() const->double;
+};
+
+auto operator<<(std::ostream& out, const RunningStats& stats)->std::ostream&;
+
+// statistics of the intervals between the channels of each coincidence, keyed by channel pair,
+// and of the stop_result of each channel
+class PairStatistics {
+public:
+	static constexpr std::size_t pairs{ stop_channels * (stop_channels - 1) / 2 };
+
+	void add(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events);
+	void merge(const PairStatistics& other);
+	void clear();
+
+	// interval in ps from channel first to channel second (0...3, first < second)
+	[[nodiscard]] auto interval(std::size_t first, std::size_t second) const->const RunningStats&;
+	[[nodiscard]] auto stop_result(std::size_t channel) const->const RunningStats&;
+
+	// one line per channel pair and channel with any entries
+	void print(std::ostream& out) const;
+
+	[[nodiscard]] static constexpr auto pair_index(std::size_t first, std::size_t second)->std::size_t {
+		return first * (2 * stop_channels - first - 1) / 2 + (second - first - 1);
+	}
+
+private:
+	std::array<RunningStats, pairs> m_intervals{};
+	std::array<RunningStats, stop_channels> m_stop_results{};
+};
+
+#endif // STATISTICS_H
@@ -0,0 +1,66 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "hit.h"
+#include "config.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// per chip calibration table used to convert raw measurements to pico seconds
+struct Calibration {
+	std::int64_t refclk_period_ps{ 200'000 };
+	std::uint32_t refclk_divisions{ 200'000 };
+	std::array<std::int64_t, stop_channels> offset_ps{}; // cable or delay offset, subtracted from the hit time
+	std::array<std::vector<std::int32_t>, stop_channels> stop_lut{}; // optional nonlinearity correction: stop_result -> ps, empty if not used
+
+	[[nodiscard]] static auto from_config(SPI::GPX2_TDC::Config config)->Calibration;
+
+	// text file with one "key values..." entry per line, see save() for the format
+	[[nodiscard]] auto load(const std::string& file)->bool;
+	[[nodiscard]] auto save(const std::string& file) const->bool;
+};
+
+// converts (ref_index, stop_result) to pico seconds using integer math only
+class Timing {
+public:
+	explicit Timing(Calibration calibration = {});
+
+	[[nodiscard]] auto time_ps(std::uint64_t ref_index, std::uint32_t stop_result, std::uint8_t channel) const->std::int64_t {
+		const auto& lut{ m_calibration.stop_lut[channel] };
+		const std::int64_t stop_ps{ (stop_result < lut.size())
+			? lut[stop_result]
+			: static_cast<std::int64_t>((stop_result * m_lsb_q32 + (std::uint64_t{ 1 } << 31U)) >> 32U) };
+		return static_cast<std::int64_t>(ref_index) * m_calibration.refclk_period_ps + stop_ps - m_calibration.offset_ps[channel];
+	}
+
+	// fills in time_ps of all hits
+	void apply(std::vector<Hit>& hits) const;
+
+	[[nodiscard]] auto calibration() const->const Calibration&;
+
+private:
+	Calibration m_calibration{};
+	std::uint64_t m_lsb_q32{}; // lsb in pico seconds as 32.32 fixed point number
+};
+
+// builds the stop_result nonlinearity table from the code density of a high rate run of uncorrelated hits.
+// since such hits are distributed uniformly over the reference period, the cumulative histogram of the
+// stop_result codes maps every code to its real position inside the period.
+class CodeDensityCalibration {
+public:
+	explicit CodeDensityCalibration(std::uint32_t refclk_divisions = 200'000);
+
+	void add(const std::vector<Hit>& hits);
+	[[nodiscard]] auto entries(std::uint8_t channel) const->std::uint64_t;
+
+	// replaces the lut of every channel with at least refclk_divisions entries, returns number of updated channels
+	[[nodiscard]] auto apply_to(Calibration& calibration) const->unsigned;
+
+private:
+	std::array<std::vector<std::uint32_t>, stop_channels> m_histogram{};
+	std::array<std::uint64_t, stop_channels> m_entries{};
+};
+
+#endif // TIMING_H
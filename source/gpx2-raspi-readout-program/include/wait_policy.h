@@ -0,0 +1,80 @@
+#ifndef WAIT_POLICY_H
+#define WAIT_POLICY_H
+
+#include "gpio.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// waits in the acquisition thread until the interrupt pin of the gpx2 is asserted (low).
+//  - Spin: polls the pin, lowest latency but keeps one core busy
+//  - Block: sleeps until the falling edge is delivered by the gpio handler
+//  - Hybrid: polls for a spin budget, then blocks. the budget adapts to the observed gaps between
+//    bursts, so short gaps are caught spinning and long idle periods cost no cpu
+class InterruptWait {
+public:
+	enum class Mode {
+		Spin,
+		Block,
+		Hybrid
+	};
+
+	enum class Wake {
+		Stopped,
+		Immediate, // the pin was still asserted, no waiting at all
+		Spin,
+		Block
+	};
+
+	struct Settings {
+		Mode mode{ Mode::Spin };
+		std::chrono::microseconds spin_budget{ 50 }; // initial budget in Hybrid mode
+		std::chrono::microseconds min_spin_budget{ 5 };
+		std::chrono::microseconds max_spin_budget{ 500 };
+		bool adaptive{ true };
+	};
+
+	struct Metrics {
+		std::atomic<std::uint64_t> waits{};
+		std::atomic<std::uint64_t> immediate{};
+		std::atomic<std::uint64_t> spin_wakeups{};
+		std::atomic<std::uint64_t> block_wakeups{};
+		std::atomic<std::uint64_t> spin_ns{}; // cpu time burned while polling
+		std::atomic<std::uint64_t> block_ns{}; // time spent asleep
+		std::atomic<std::uint64_t> latency_ns{}; // sum over latency_count wakeups, from the falling edge to the wakeup
+		std::atomic<std::uint64_t> latency_count{};
+		std::atomic<std::uint64_t> max_latency_ns{};
+		std::atomic<std::int64_t> spin_budget_ns{};
+	};
+
+	// the metrics are owned by the caller, so they can be read from other threads for the whole runtime
+	InterruptWait(Settings settings, gpio::callback& callback, unsigned pin, Metrics& metrics);
+
+	// returns once the pin is asserted or run is cleared
+	[[nodiscard]] auto wait(const std::atomic<bool>& run)->Wake;
+
+	[[nodiscard]] static auto parse_mode(const std::string& name, Mode& mode)->bool;
+
+private:
+	[[nodiscard]] auto asserted()->bool;
+	void drain_events();
+	void record_latency();
+	void adapt(std::chrono::nanoseconds gap);
+	void spent(std::atomic<std::uint64_t>& counter, std::chrono::steady_clock::duration duration);
+
+	static constexpr std::chrono::milliseconds block_timeout{ 10 };
+
+	Settings m_settings{};
+	gpio::callback& m_callback;
+	unsigned m_pin{};
+	std::chrono::nanoseconds m_budget{};
+	std::vector<gpio::event> m_events{};
+	Metrics& m_metrics;
+};
+
+auto operator<<(std::ostream& out, const InterruptWait::Metrics& metrics)->std::ostream&;
+
+#endif // WAIT_POLICY_H
@@ -0,0 +1,47 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include "gpx2.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// checks the config registers of the running chip against the written config, a few registers at a time
+// in turn, and writes back the ones which differ (e.g. after a brown out). runs in the acquisition thread
+// between two drains, the measurement itself is not touched.
+class RegisterWatchdog {
+public:
+	struct Settings {
+		std::chrono::milliseconds interval{ 1000 }; // 0 disables the watchdog
+		unsigned registers_per_check{ 2 };
+	};
+
+	// read from other threads
+	struct Counters {
+		std::atomic<std::uint64_t> checked{ 0 }; // registers read back
+		std::atomic<std::uint64_t> repaired{ 0 };
+		std::atomic<std::uint64_t> failed{ 0 }; // registers which still differed after writing them
+	};
+
+	explicit RegisterWatchdog(Settings settings);
+
+	// registers holds the values of all 17 config registers
+	void expect(const std::string& registers);
+	[[nodiscard]] auto due(std::chrono::steady_clock::time_point now) const->bool;
+	// checks the next registers, false if one of them could not be repaired
+	[[nodiscard]] auto check(SPI::GPX2_TDC::GPX2& gpx2)->bool;
+	[[nodiscard]] auto counters() const->const Counters&;
+
+private:
+	Settings m_settings{};
+	std::string m_registers{};
+	std::size_t m_next{ 0 };
+	std::chrono::steady_clock::time_point m_next_check{};
+	Counters m_counters{};
+};
+
+auto operator<<(std::ostream& out, const RegisterWatchdog::Counters& counters)->std::ostream&;
+
+#endif // WATCHDOG_H
@@ -0,0 +1,255 @@
+#include "analysis.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+
+namespace {
+constexpr std::int64_t min_margin_ps{ 1'000'000'000 }; // same as the reorder window of the live engine
+
+auto mix(std::uint64_t x)->std::uint64_t {
+	x ^= x >> 33U;
+	x *= 0xFF51AFD7ED558CCDULL;
+	x ^= x >> 33U;
+	x *= 0xC4CEB9FE1A85EC53ULL;
+	x ^= x >> 33U;
+	return x;
+}
+
+// order independent, so the checksums of the chunks can be added up
+auto event_hash(const CoincidenceEvent& event)->std::uint64_t {
+	std::uint64_t h{ mix(static_cast<std::uint64_t>(event.time_ps)) };
+	for (const auto offset : event.offset_ps) {
+		h = mix(h ^ static_cast<std::uint32_t>(offset));
+	}
+	return mix(h ^ (static_cast<std::uint64_t>(event.group) << 8U) ^ event.channel_mask);
+}
+}
+
+Histogram::Histogram(std::int64_t min, std::int64_t max, std::int64_t bin)
+	: min_ps{ min }
+	, bin_ps{ std::max<std::int64_t>(bin, 1) }
+	, counts(static_cast<std::size_t>(std::max<std::int64_t>((max - min + bin_ps - 1) / bin_ps, 1)))
+{
+}
+
+void Histogram::add(std::int64_t value) {
+	if (value < min_ps) {
+		underflow++;
+		return;
+	}
+	const auto bin{ static_cast<std::size_t>((value - min_ps) / bin_ps) };
+	if (bin >= counts.size()) {
+		overflow++;
+		return;
+	}
+	counts[bin]++;
+}
+
+void Histogram::merge(const Histogram& other) {
+	if (counts.size() < other.counts.size()) {
+		counts.resize(other.counts.size());
+	}
+	for (std::size_t i{ 0 }; i < other.counts.size(); i++) {
+		counts[i] += other.counts[i];
+	}
+	underflow += other.underflow;
+	overflow += other.overflow;
+}
+
+void AnalysisResult::merge(const AnalysisResult& other) {
+	hits += other.hits;
+	events += other.events;
+	checksum += other.checksum;
+	for (std::size_t i{ 0 }; i < intervals.size(); i++) {
+		intervals[i].merge(other.intervals[i]);
+	}
+	statistics.merge(other.statistics);
+}
+
+void AnalysisResult::print(std::ostream& out) const {
+	out << hits << " hits, " << events << " coincidences, checksum " << std::hex << checksum << std::dec << "\n";
+	statistics.print(out);
+}
+
+OfflineAnalysis::OfflineAnalysis(Settings settings)
+	: m_settings{ std::move(settings) }
+	, m_timing{ m_settings.calibration }
+{
+	for (const auto& group : m_settings.groups) {
+		const auto delay{ *std::max_element(group.delay_ps.begin(), group.delay_ps.end()) };
+		m_range_ps = std::max(m_range_ps, group.window_ps + delay);
+	}
+	m_margin_ps = m_settings.margin_ps > 0 ? m_settings.margin_ps : std::max(10 * m_range_ps, min_margin_ps);
+	m_settings.threads = std::max(m_settings.threads, 1U);
+	m_settings.chunk_hits = std::max<std::size_t>(m_settings.chunk_hits, 1);
+}
+
+auto OfflineAnalysis::run(const std::string& file, AnalysisResult& result, const std::function<void(const std::vector<CoincidenceEvent>&)>& on_events)->bool {
+	std::ifstream in{ file, std::ios::binary };
+	if (!in) {
+		std::cerr << "could not open " << file << std::endl;
+		return false;
+	}
+	std::vector<BlockIndex> blocks{};
+	const auto skipped{ index_blocks(in, blocks) };
+	if (skipped > 0) {
+		std::cerr << "skipped " << skipped << " bytes of corrupt data in " << file << std::endl;
+	}
+
+	// chunks at block boundaries, the boundaries in time are kept monotonic even if blocks overlap a bit
+	const auto period{ m_settings.calibration.refclk_period_ps };
+	std::vector<Chunk> chunks{};
+	std::size_t hits{ 0 };
+	for (std::size_t b{ 0 }; b < blocks.size(); b++) {
+		if (chunks.empty() || hits >= m_settings.chunk_hits) {
+			Chunk chunk{};
+			chunk.first_block = b;
+			chunk.begin_ps = chunks.empty() ? std::numeric_limits<std::int64_t>::min()
+				: std::max(chunks.back().begin_ps, static_cast<std::int64_t>(blocks[b].first_ref) * period);
+			if (!chunks.empty()) {
+				chunks.back().last_block = b;
+				chunks.back().end_ps = chunk.begin_ps;
+			}
+			chunks.push_back(chunk);
+			hits = 0;
+		}
+		hits += blocks[b].hits;
+	}
+	if (!chunks.empty()) {
+		chunks.back().last_block = blocks.size();
+		chunks.back().end_ps = std::numeric_limits<std::int64_t>::max();
+	}
+
+	result = empty_result();
+	const bool keep_events{ static_cast<bool>(on_events) };
+	std::vector<AnalysisResult> partial(chunks.size());
+	std::vector<std::vector<CoincidenceEvent>> events(chunks.size());
+	std::vector<bool> done(chunks.size(), false);
+	std::mutex mutex{};
+	std::condition_variable changed{};
+	std::atomic<std::size_t> next{ 0 };
+	std::size_t merged{ 0 };
+	// at most this many chunks are analysed ahead of the merge, which bounds the memory
+	const std::size_t ahead{ 2U * m_settings.threads };
+
+	std::vector<std::thread> workers{};
+	for (unsigned t{ 0 }; t < std::min<std::size_t>(m_settings.threads, chunks.size()); t++) {
+		workers.emplace_back([&] {
+			while (true) {
+				const std::size_t c{ next++ };
+				if (c >= chunks.size()) {
+					return;
+				}
+				{
+					std::unique_lock<std::mutex> lock{ mutex };
+					changed.wait(lock, [&] { return c < merged + ahead; });
+				}
+				AnalysisResult part{ empty_result() };
+				std::vector<CoincidenceEvent> chunk_events{};
+				analyse(file, blocks, chunks[c], part, chunk_events);
+				if (!keep_events) {
+					chunk_events = {};
+				}
+				std::lock_guard<std::mutex> lock{ mutex };
+				partial[c] = std::move(part);
+				events[c] = std::move(chunk_events);
+				done[c] = true;
+				changed.notify_all();
+			}
+		});
+	}
+	for (std::size_t c{ 0 }; c < chunks.size(); c++) {
+		std::unique_lock<std::mutex> lock{ mutex };
+		changed.wait(lock, [&] { return static_cast<bool>(done[c]); });
+		auto part{ std::move(partial[c]) };
+		auto chunk_events{ std::move(events[c]) };
+		lock.unlock();
+		result.merge(part);
+		if (keep_events) {
+			on_events(chunk_events);
+		}
+		lock.lock();
+		merged = c + 1;
+		changed.notify_all();
+	}
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	return true;
+}
+
+void OfflineAnalysis::analyse(const std::string& file, const std::vector<BlockIndex>& blocks, const Chunk& chunk, AnalysisResult& result, std::vector<CoincidenceEvent>& events) const {
+	const auto period{ m_settings.calibration.refclk_period_ps };
+	const auto min{ std::numeric_limits<std::int64_t>::min() };
+	const auto max{ std::numeric_limits<std::int64_t>::max() };
+	const std::int64_t lo{ chunk.begin_ps == min ? min : chunk.begin_ps - m_margin_ps };
+	const std::int64_t hi{ chunk.end_ps == max ? max : chunk.end_ps + m_margin_ps };
+	// the margins are taken from the neighbouring blocks, including the ones reaching into them
+	std::size_t first{ chunk.first_block };
+	while (first > 0 && static_cast<std::int64_t>(blocks[first].first_ref) * period > lo) {
+		first--;
+	}
+	std::size_t last{ chunk.last_block };
+	while (last < blocks.size() && static_cast<std::int64_t>(blocks[last].first_ref) * period < hi) {
+		last++;
+	}
+
+	std::ifstream in{ file, std::ios::binary };
+	std::vector<std::uint8_t> buffer{};
+	std::vector<Hit> hits{};
+	std::vector<CoincidenceEvent> recorded{};
+	for (std::size_t b{ first }; b < last; b++) {
+		buffer.resize(blocks[b].size);
+		in.seekg(static_cast<std::streamoff>(blocks[b].offset));
+		in.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+		std::size_t consumed{};
+		// corrupt payloads are skipped, like BlockReader does
+		[[maybe_unused]] const auto status{ decode_block(buffer.data(), static_cast<std::size_t>(in.gcount()), hits, recorded, consumed) };
+		recorded.clear();
+	}
+	m_timing.apply(hits);
+	hits.erase(std::remove_if(hits.begin(), hits.end(), [&](const Hit& hit) { return hit.time_ps < lo || hit.time_ps >= hi; }), hits.end());
+
+	CoincidenceEngine engine{ m_settings.groups };
+	std::vector<CoincidenceEvent> found{};
+	engine.process(hits, found, true);
+	for (const auto& event : found) {
+		if (event.time_ps >= chunk.begin_ps && event.time_ps < chunk.end_ps) {
+			events.push_back(event);
+		}
+	}
+
+	// hits is sorted by now, the hits of the chunk itself are a contiguous range
+	Hit bound{};
+	bound.time_ps = chunk.begin_ps;
+	const auto begin{ std::lower_bound(hits.begin(), hits.end(), bound) };
+	bound.time_ps = chunk.end_ps;
+	const auto end{ std::lower_bound(begin, hits.end(), bound) };
+	const std::vector<Hit> own(begin, end);
+
+	result.hits = own.size();
+	result.events = events.size();
+	for (const auto& event : events) {
+		result.checksum += event_hash(event);
+		for (std::size_t a{ 0 }; a < stop_channels; a++) {
+			for (std::size_t b{ a + 1 }; b < stop_channels; b++) {
+				if ((event.channel_mask & (1U << a)) != 0 && (event.channel_mask & (1U << b)) != 0) {
+					result.intervals[PairStatistics::pair_index(a, b)].add(event.offset_ps[b] - event.offset_ps[a]);
+				}
+			}
+		}
+	}
+	result.statistics.add(own, events);
+}
+
+auto OfflineAnalysis::empty_result() const->AnalysisResult {
+	AnalysisResult result{};
+	for (auto& histogram : result.intervals) {
+		histogram = Histogram{ -m_range_ps, m_range_ps + 1, m_settings.histogram_bin_ps };
+	}
+	return result;
+}
@@ -0,0 +1,110 @@
+#include "batching.h"
+#include <algorithm>
+
+namespace {
+constexpr double smoothing{ 0.2 };
+
+auto seconds(std::chrono::nanoseconds duration)->double {
+	return std::chrono::duration<double>(duration).count();
+}
+}
+
+BatchController::BatchController(Settings settings)
+	: m_settings{ settings }
+	, m_batch_size{ settings.min_batch }
+	, m_period{ std::max<std::chrono::nanoseconds>(settings.latency_target / 2, settings.min_period) }
+	, m_last_update{ std::chrono::steady_clock::now() }
+{
+}
+
+auto BatchController::update(std::size_t hits, std::chrono::nanoseconds latency, std::chrono::nanoseconds processing)->bool {
+	m_batches++;
+	m_hits += hits;
+	m_latency_sum += latency;
+	m_latency_max = std::max(m_latency_max, latency);
+	const std::chrono::nanoseconds target{ m_settings.latency_target };
+	const auto correct{ [&] {
+		if (latency > target) {
+			m_factor = std::max(0.05, m_factor * 0.8);
+		} else if (latency < target / 2) {
+			m_factor = std::min(1., m_factor * 1.05);
+		}
+	} };
+	if (hits == 0) {
+		// only kept back hits were released, nothing to learn about the rate and the cost.
+		// their wait still shortens the next flush period
+		correct();
+		return false;
+	}
+	const auto now{ std::chrono::steady_clock::now() };
+	const double elapsed{ seconds(now - m_last_update) };
+	m_last_update = now;
+
+	const auto smooth{ [](double& value, double sample) {
+		value = value == 0. ? sample : value + smoothing * (sample - value);
+	} };
+	if (elapsed > 0.) {
+		smooth(m_rate, static_cast<double>(hits) / elapsed);
+	}
+	smooth(m_cost, seconds(processing) / static_cast<double>(hits));
+
+	// the processing does not keep up with the input if it is busy all the time, or if far more hits
+	// than requested pile up before it runs, e.g. because it does not get enough cpu.
+	// the target cannot be met anyway, the largest batches lose the least time on overhead
+	if (m_rate * m_cost >= 0.9 || hits > 4 * batch_size()) {
+		m_batch_size.store(m_settings.max_batch, std::memory_order_relaxed);
+		if (m_period != target) {
+			m_period = target;
+			return true;
+		}
+		return false;
+	}
+	correct();
+
+	// filling a batch takes size / rate and processing it size * cost, both together have to fit into the target
+	const double fill_and_process{ (m_rate > 0. ? 1. / m_rate : 0.) + m_cost };
+	double size{ static_cast<double>(m_settings.max_batch) };
+	if (fill_and_process > 0.) {
+		size = std::min(size, seconds(target) * m_factor / fill_and_process);
+	}
+	m_batch_size.store(std::clamp(static_cast<std::size_t>(size), m_settings.min_batch, m_settings.max_batch), std::memory_order_relaxed);
+
+	// a hit arriving right after a flush waits one period plus the processing of its batch
+	const auto expected_processing{ std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(m_cost * static_cast<double>(batch_size()))) };
+	const auto period{ std::clamp<std::chrono::nanoseconds>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(2. * m_factor * target) - expected_processing,
+		m_settings.min_period, target) };
+	// small changes are not worth to restart the timer
+	if (period * 10 < m_period * 9 || period * 10 > m_period * 11) {
+		m_period = period;
+		return true;
+	}
+	return false;
+}
+
+auto BatchController::period() const->std::chrono::nanoseconds {
+	return m_period;
+}
+
+auto BatchController::stats()->Stats {
+	Stats result{};
+	result.batches = m_batches;
+	result.hits = m_hits;
+	result.mean_latency = m_batches > 0 ? m_latency_sum / static_cast<std::int64_t>(m_batches) : std::chrono::nanoseconds{};
+	result.max_latency = m_latency_max;
+	result.batch_size = batch_size();
+	result.period = m_period;
+	m_batches = 0;
+	m_hits = 0;
+	m_latency_sum = {};
+	m_latency_max = {};
+	return result;
+}
+
+auto operator<<(std::ostream& out, const BatchController::Stats& stats)->std::ostream& {
+	const auto ms{ [](std::chrono::nanoseconds value) { return std::chrono::duration<double, std::milli>(value).count(); } };
+	out << stats.batches << " batches, " << (stats.batches > 0 ? stats.hits / stats.batches : 0U) << " hits per batch";
+	out << ", latency mean " << ms(stats.mean_latency) << " ms max " << ms(stats.max_latency) << " ms";
+	out << ", batch size " << stats.batch_size << ", flush period " << ms(stats.period) << " ms";
+	return out;
+}
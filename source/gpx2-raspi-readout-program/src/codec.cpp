@@ -0,0 +1,355 @@
+#include "codec.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+namespace {
+constexpr std::size_t bitpack_padding { 8 }; // allows the decoder to always load 64 bits
+constexpr std::uint32_t max_payload_size { 1U << 28U };
+
+auto crc_table()->const std::array<std::uint32_t, 256>& {
+	static const auto table{ [] {
+		std::array<std::uint32_t, 256> t{};
+		for (std::uint32_t i{ 0 }; i < t.size(); i++) {
+			std::uint32_t c{ i };
+			for (int k{ 0 }; k < 8; k++) {
+				c = (c & 1U) ? 0xEDB88320U ^ (c >> 1U) : c >> 1U;
+			}
+			t[i] = c;
+		}
+		return t;
+	}() };
+	return table;
+}
+
+constexpr auto zigzag(std::int64_t value)->std::uint64_t {
+	return (static_cast<std::uint64_t>(value) << 1U) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+constexpr auto unzigzag(std::uint64_t value)->std::int64_t {
+	return static_cast<std::int64_t>(value >> 1U) ^ -static_cast<std::int64_t>(value & 1U);
+}
+
+void put_varint(std::vector<std::uint8_t>& out, std::uint64_t value) {
+	while (value >= 0x80U) {
+		out.push_back(static_cast<std::uint8_t>(value | 0x80U));
+		value >>= 7U;
+	}
+	out.push_back(static_cast<std::uint8_t>(value));
+}
+
+// returns false if the varint does not end before end
+auto get_varint(const std::uint8_t*& pos, const std::uint8_t* end, std::uint64_t& value)->bool {
+	value = 0;
+	for (unsigned shift{ 0 }; pos < end && shift < 64; shift += 7) {
+		const std::uint8_t byte{ *pos++ };
+		value |= static_cast<std::uint64_t>(byte & 0x7FU) << shift;
+		if ((byte & 0x80U) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+auto bit_width(std::uint32_t value)->std::uint8_t {
+	std::uint8_t bits{ 0 };
+	for (; value != 0; value >>= 1U) {
+		bits++;
+	}
+	return bits;
+}
+
+auto header_crc(BlockHeader header)->std::uint32_t {
+	header.header_checksum = 0;
+	return crc32(reinterpret_cast<const std::uint8_t*>(&header), sizeof(header));
+}
+}
+
+auto crc32(const std::uint8_t* data, std::size_t size, std::uint32_t crc)->std::uint32_t {
+	const auto& table{ crc_table() };
+	crc = ~crc;
+	for (std::size_t i{ 0 }; i < size; i++) {
+		crc = table[(crc ^ data[i]) & 0xFFU] ^ (crc >> 8U);
+	}
+	return ~crc;
+}
+
+void encode_block(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events, std::vector<std::uint8_t>& out) {
+	BlockHeader header{};
+	header.magic = block_magic;
+	header.version = block_version;
+	header.hits = static_cast<std::uint32_t>(hits.size());
+	header.events = static_cast<std::uint32_t>(events.size());
+
+	std::array<bool, stop_channels> seen{};
+	std::uint32_t max_stop{ 0 };
+	for (const auto& hit : hits) {
+		if (!seen[hit.channel]) {
+			seen[hit.channel] = true;
+			header.ref_base[hit.channel] = hit.ref_index;
+		}
+		max_stop = std::max(max_stop, hit.stop_result);
+	}
+	header.stop_bits = bit_width(max_stop);
+
+	const std::size_t header_pos{ out.size() };
+	out.resize(header_pos + sizeof(BlockHeader));
+	const std::size_t payload_pos{ out.size() };
+
+	// channels, 2 bit each
+	const std::size_t channel_pos{ out.size() };
+	out.resize(channel_pos + (hits.size() + 3U) / 4U);
+	for (std::size_t i{ 0 }; i < hits.size(); i++) {
+		out[channel_pos + i / 4U] |= static_cast<std::uint8_t>((hits[i].channel & 0x3U) << (2U * (i % 4U)));
+	}
+
+	// ref_index deltas per channel
+	const std::size_t ref_pos{ out.size() };
+	std::array<std::uint64_t, stop_channels> previous{};
+	std::copy(std::begin(header.ref_base), std::end(header.ref_base), previous.begin());
+	for (const auto& hit : hits) {
+		put_varint(out, zigzag(static_cast<std::int64_t>(hit.ref_index - previous[hit.channel])));
+		previous[hit.channel] = hit.ref_index;
+	}
+	header.ref_bytes = static_cast<std::uint32_t>(out.size() - ref_pos);
+
+	// bit-packed stop results
+	const std::size_t stop_pos{ out.size() };
+	out.resize(stop_pos + (hits.size() * header.stop_bits + 7U) / 8U + bitpack_padding);
+	std::uint64_t bits{ 0 };
+	unsigned bit_count{ 0 };
+	std::size_t byte{ stop_pos };
+	for (const auto& hit : hits) {
+		bits |= static_cast<std::uint64_t>(hit.stop_result) << bit_count;
+		bit_count += header.stop_bits;
+		for (; bit_count >= 8; bit_count -= 8, bits >>= 8U) {
+			out[byte++] = static_cast<std::uint8_t>(bits);
+		}
+	}
+	if (bit_count > 0) {
+		out[byte] = static_cast<std::uint8_t>(bits);
+	}
+
+	// coincidences
+	std::int64_t previous_time{ 0 };
+	for (const auto& event : events) {
+		put_varint(out, zigzag(event.time_ps - previous_time));
+		previous_time = event.time_ps;
+		out.push_back(event.group);
+		out.push_back(event.channel_mask);
+		for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+			if ((event.channel_mask & (1U << ch)) != 0) {
+				put_varint(out, static_cast<std::uint32_t>(event.offset_ps[ch]));
+			}
+		}
+	}
+
+	header.payload_size = static_cast<std::uint32_t>(out.size() - payload_pos);
+	header.checksum = crc32(out.data() + payload_pos, header.payload_size);
+	header.header_checksum = header_crc(header);
+	std::memcpy(out.data() + header_pos, &header, sizeof(header));
+}
+
+auto decode_block(const std::uint8_t* data, std::size_t size, std::vector<Hit>& hits, std::vector<CoincidenceEvent>& events, std::size_t& consumed)->DecodeStatus {
+	consumed = 0;
+	if (size < sizeof(std::uint32_t)) {
+		return DecodeStatus::Incomplete;
+	}
+	BlockHeader header{};
+	std::memcpy(&header.magic, data, sizeof(header.magic));
+	if (header.magic != block_magic) {
+		consumed = 1;
+		return DecodeStatus::Corrupt;
+	}
+	if (size < sizeof(BlockHeader)) {
+		return DecodeStatus::Incomplete;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (header.version != block_version || header.header_checksum != header_crc(header) || header.payload_size > max_payload_size || header.stop_bits > 32) {
+		consumed = 1;
+		return DecodeStatus::Corrupt;
+	}
+	if (size < sizeof(BlockHeader) + header.payload_size) {
+		return DecodeStatus::Incomplete;
+	}
+	const std::uint8_t* payload{ data + sizeof(BlockHeader) };
+	const std::uint8_t* end{ payload + header.payload_size };
+	const std::size_t channel_bytes{ (header.hits + 3U) / 4U };
+	const std::size_t stop_bytes{ (static_cast<std::size_t>(header.hits) * header.stop_bits + 7U) / 8U + bitpack_padding };
+	if (crc32(payload, header.payload_size) != header.checksum || channel_bytes + header.ref_bytes + stop_bytes > header.payload_size) {
+		consumed = 1;
+		return DecodeStatus::Corrupt;
+	}
+
+	const std::size_t first_hit{ hits.size() };
+	const std::size_t first_event{ events.size() };
+	hits.resize(first_hit + header.hits);
+	Hit* out{ hits.data() + first_hit };
+
+	// fixed width fields first, these loops have no data dependent branches and vectorise well
+	for (std::size_t i{ 0 }; i < header.hits; i++) {
+		out[i].channel = static_cast<std::uint8_t>((payload[i / 4U] >> (2U * (i % 4U))) & 0x3U);
+	}
+	const std::uint8_t* stops{ payload + channel_bytes + header.ref_bytes };
+	const std::uint64_t stop_mask{ (std::uint64_t{ 1 } << header.stop_bits) - 1U };
+	for (std::size_t i{ 0 }; i < header.hits; i++) {
+		const std::size_t bit{ i * header.stop_bits };
+		std::uint64_t word{};
+		std::memcpy(&word, stops + bit / 8U, sizeof(word));
+		out[i].stop_result = static_cast<std::uint32_t>((word >> (bit % 8U)) & stop_mask);
+	}
+
+	const std::uint8_t* pos{ payload + channel_bytes };
+	const std::uint8_t* ref_end{ pos + header.ref_bytes };
+	std::array<std::uint64_t, stop_channels> previous{};
+	std::copy(std::begin(header.ref_base), std::end(header.ref_base), previous.begin());
+	for (std::size_t i{ 0 }; i < header.hits; i++) {
+		std::uint64_t delta{};
+		if (!get_varint(pos, ref_end, delta)) {
+			hits.resize(first_hit);
+			consumed = 1;
+			return DecodeStatus::Corrupt;
+		}
+		auto& ref{ previous[out[i].channel] };
+		ref = static_cast<std::uint64_t>(static_cast<std::int64_t>(ref) + unzigzag(delta));
+		out[i].ref_index = ref;
+	}
+
+	pos = stops + stop_bytes;
+	std::int64_t previous_time{ 0 };
+	for (std::size_t i{ 0 }; i < header.events; i++) {
+		CoincidenceEvent event{};
+		std::uint64_t value{};
+		if (!get_varint(pos, end, value) || end - pos < 2) {
+			hits.resize(first_hit);
+			events.resize(first_event);
+			consumed = 1;
+			return DecodeStatus::Corrupt;
+		}
+		previous_time += unzigzag(value);
+		event.time_ps = previous_time;
+		event.group = *pos++;
+		event.channel_mask = *pos++;
+		for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+			if ((event.channel_mask & (1U << ch)) == 0) {
+				continue;
+			}
+			if (!get_varint(pos, end, value)) {
+				hits.resize(first_hit);
+				events.resize(first_event);
+				consumed = 1;
+				return DecodeStatus::Corrupt;
+			}
+			event.offset_ps[ch] = static_cast<std::int32_t>(value);
+		}
+		events.push_back(event);
+	}
+	consumed = sizeof(BlockHeader) + header.payload_size;
+	return DecodeStatus::Ok;
+}
+
+auto index_blocks(std::istream& in, std::vector<BlockIndex>& blocks)->std::uint64_t {
+	std::uint64_t skipped{ 0 };
+	std::uint64_t pos{ 0 };
+	std::vector<char> search(1U << 16U);
+	while (true) {
+		BlockHeader header{};
+		in.clear();
+		in.seekg(static_cast<std::streamoff>(pos));
+		in.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (in.gcount() == 0) {
+			return skipped;
+		}
+		const bool valid{ in.gcount() == sizeof(header) && header.magic == block_magic && header.version == block_version
+			&& header.header_checksum == header_crc(header) && header.payload_size <= max_payload_size };
+		if (valid) {
+			if (header.hits > 0) {
+				BlockIndex block{};
+				block.offset = pos;
+				block.size = sizeof(header) + header.payload_size;
+				block.hits = header.hits;
+				block.first_ref = std::numeric_limits<std::uint64_t>::max();
+				// ref_base of channels without hits is 0, a real ref_index of 0 only occurs at the very start
+				for (const auto ref : header.ref_base) {
+					if (ref != 0) {
+						block.first_ref = std::min(block.first_ref, ref);
+					}
+				}
+				if (block.first_ref == std::numeric_limits<std::uint64_t>::max()) {
+					block.first_ref = 0;
+				}
+				blocks.push_back(block);
+			}
+			pos += sizeof(header) + header.payload_size;
+			continue;
+		}
+		if (in.gcount() < static_cast<std::streamsize>(sizeof(header))) {
+			return skipped + static_cast<std::uint64_t>(in.gcount());
+		}
+		// search the next block magic
+		std::uint64_t next{ pos + 1 };
+		bool found{ false };
+		while (!found) {
+			in.clear();
+			in.seekg(static_cast<std::streamoff>(next));
+			in.read(search.data(), static_cast<std::streamsize>(search.size()));
+			const auto n{ static_cast<std::size_t>(in.gcount()) };
+			if (n < sizeof(block_magic)) {
+				return skipped + (next - pos) + n;
+			}
+			for (std::size_t i{ 0 }; i + sizeof(block_magic) <= n; i++) {
+				std::uint32_t magic{};
+				std::memcpy(&magic, search.data() + i, sizeof(magic));
+				if (magic == block_magic) {
+					next += i;
+					found = true;
+					break;
+				}
+			}
+			if (!found) {
+				next += n - (sizeof(block_magic) - 1);
+			}
+		}
+		skipped += next - pos;
+		pos = next;
+	}
+}
+
+BlockReader::BlockReader(std::istream& in)
+	: m_in{ in }
+{
+}
+
+auto BlockReader::next(std::vector<Hit>& hits, std::vector<CoincidenceEvent>& events)->bool {
+	constexpr std::size_t read_size{ 1U << 20U };
+	while (true) {
+		std::size_t consumed{};
+		const auto status{ decode_block(m_buffer.data() + m_pos, m_buffer.size() - m_pos, hits, events, consumed) };
+		if (status == DecodeStatus::Ok) {
+			m_pos += consumed;
+			return true;
+		}
+		if (status == DecodeStatus::Corrupt) {
+			m_pos += consumed;
+			m_skipped += consumed;
+			continue;
+		}
+		// incomplete: move the rest to the front and read more
+		m_buffer.erase(m_buffer.begin(), m_buffer.begin() + static_cast<std::ptrdiff_t>(m_pos));
+		m_pos = 0;
+		if (!m_in) {
+			m_skipped += m_buffer.size();
+			m_buffer.clear();
+			return false;
+		}
+		const std::size_t old_size{ m_buffer.size() };
+		m_buffer.resize(old_size + read_size);
+		m_in.read(reinterpret_cast<char*>(m_buffer.data() + old_size), static_cast<std::streamsize>(read_size));
+		m_buffer.resize(old_size + static_cast<std::size_t>(m_in.gcount()));
+	}
+}
+
+auto BlockReader::skipped_bytes() const->std::uint64_t {
+	return m_skipped;
+}
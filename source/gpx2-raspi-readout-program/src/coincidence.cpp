@@ -0,0 +1,243 @@
+#include "coincidence.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace {
+constexpr auto bit_count(std::uint8_t mask)->unsigned {
+	unsigned count{ 0 };
+	for (; mask != 0; mask &= static_cast<std::uint8_t>(mask - 1U)) {
+		count++;
+	}
+	return count;
+}
+
+auto mask_of(std::initializer_list<unsigned> stops)->std::uint8_t {
+	std::uint8_t mask{ 0 };
+	for (auto stop : stops) {
+		if (stop >= 1 && stop <= stop_channels) {
+			mask |= static_cast<std::uint8_t>(1U << (stop - 1U));
+		}
+	}
+	return mask;
+}
+}
+
+auto CoincidenceGroup::of(std::initializer_list<unsigned> stops, double window)->CoincidenceGroup {
+	CoincidenceGroup group{};
+	group.channel_mask = mask_of(stops);
+	group.multiplicity = static_cast<std::uint8_t>(bit_count(group.channel_mask));
+	group.window_ps = std::llround(window * 1e12);
+	return group;
+}
+
+auto CoincidenceGroup::any_of(unsigned n, std::initializer_list<unsigned> stops, double window)->CoincidenceGroup {
+	CoincidenceGroup group{ of(stops, window) };
+	group.multiplicity = static_cast<std::uint8_t>(std::min(n, bit_count(group.channel_mask)));
+	return group;
+}
+
+CoincidenceEngine::CoincidenceEngine(std::vector<CoincidenceGroup> groups, std::int64_t reorder_window_ps, std::vector<std::int64_t> accidental_delays_ps)
+	: m_groups{ std::move(groups) }
+	, m_windows(m_groups.size())
+	, m_counts(m_groups.size())
+	, m_reorder_window_ps{ reorder_window_ps }
+{
+	for (const auto& group : m_groups) {
+		m_max_delay_ps.push_back(*std::max_element(group.delay_ps.begin(), group.delay_ps.end()));
+	}
+	for (std::size_t g{ 0 }; g < m_groups.size(); g++) {
+		if (bit_count(m_groups[g].channel_mask) < 2) {
+			continue;
+		}
+		for (auto delay : accidental_delays_ps) {
+			if (delay <= 0) {
+				continue;
+			}
+			Delayed delayed{};
+			delayed.group = g;
+			delayed.delay_ps = delay;
+			std::int64_t shift{ 0 };
+			for (std::uint8_t ch{ 0 }; ch < stop_channels; ch++) {
+				if ((m_groups[g].channel_mask & (1U << ch)) != 0) {
+					delayed.shift_ps[ch] = shift;
+					shift += delay;
+				}
+			}
+			m_delayed.push_back(delayed);
+		}
+	}
+}
+
+auto CoincidenceEngine::groups() const->const std::vector<CoincidenceGroup>& {
+	return m_groups;
+}
+
+void CoincidenceEngine::set_window(std::size_t group, std::int64_t window_ps) {
+	if (group < m_groups.size()) {
+		m_groups[group].window_ps = window_ps;
+	}
+}
+
+auto CoincidenceEngine::max_window() const->std::int64_t {
+	return m_reorder_window_ps;
+}
+
+auto CoincidenceEngine::pending() const->std::size_t {
+	return m_pending.size();
+}
+
+auto CoincidenceEngine::counts() const->const std::vector<std::uint64_t>& {
+	return m_counts;
+}
+
+auto CoincidenceEngine::accidentals() const->std::vector<Accidentals> {
+	std::vector<Accidentals> result{};
+	for (const auto& delayed : m_delayed) {
+		result.push_back(Accidentals{ delayed.group, delayed.delay_ps, delayed.count });
+	}
+	return result;
+}
+
+void CoincidenceEngine::process(std::vector<Hit>& hits, std::vector<CoincidenceEvent>& events, bool flush) {
+	// merge the new batch into the hits kept back from the last call
+	// into a scratch buffer which keeps its capacity, std::inplace_merge would allocate on every call
+	m_sorter.sort(hits);
+	m_merged.resize(m_pending.size() + hits.size());
+	std::merge(m_pending.begin(), m_pending.end(), hits.begin(), hits.end(), m_merged.begin());
+	m_pending.swap(m_merged);
+	if (m_pending.empty()) {
+		return;
+	}
+
+	auto end{ m_pending.end() };
+	if (!flush) {
+		Hit limit{};
+		limit.time_ps = m_pending.back().time_ps - m_reorder_window_ps;
+		end = std::upper_bound(m_pending.begin(), m_pending.end(), limit);
+	}
+	for (auto it{ m_pending.begin() }; it != end; ++it) {
+		step(*it, events);
+	}
+	m_pending.erase(m_pending.begin(), end);
+
+	if (flush) {
+		for (std::size_t g{ 0 }; g < m_groups.size(); g++) {
+			close(g, events);
+		}
+		for (auto& delayed : m_delayed) {
+			const auto close_delayed{ [&](Window& window) {
+				delayed.count += complete(delayed.group, window) ? 1U : 0U;
+				window = Window{};
+			} };
+			release(delayed, std::numeric_limits<std::int64_t>::max(), close_delayed);
+			close_delayed(delayed.window);
+		}
+	}
+}
+
+template <typename Close>
+void CoincidenceEngine::match(std::size_t g, Window& window, std::uint8_t channel, std::int64_t time_ps, Close&& close) {
+	const auto& group{ m_groups[g] };
+	const auto bit{ static_cast<std::uint8_t>(1U << channel) };
+
+	// no later hit can join the open window anymore
+	if (window.channel_mask != 0 && time_ps - m_max_delay_ps[g] - window.first_ps > group.window_ps) {
+		close(window);
+	}
+	if ((group.channel_mask & bit) == 0) {
+		return;
+	}
+	const std::int64_t time{ time_ps - group.delay_ps[channel] };
+	if (window.channel_mask != 0 && ((time - window.first_ps > group.window_ps) || (window.channel_mask & bit) != 0)) {
+		if (bit_count(window.channel_mask) >= group.multiplicity) {
+			close(window);
+		} else {
+			// not enough channels yet, slide the window forward
+			window.channel_mask &= static_cast<std::uint8_t>(~bit);
+			evict(window, time - group.window_ps);
+		}
+	}
+	window.time_ps[channel] = time;
+	window.channel_mask |= bit;
+	window.first_ps = std::min(window.first_ps, time);
+	if (window.channel_mask == group.channel_mask) {
+		close(window);
+	}
+}
+
+void CoincidenceEngine::step(const Hit& hit, std::vector<CoincidenceEvent>& events) {
+	for (std::size_t g{ 0 }; g < m_groups.size(); g++) {
+		match(g, m_windows[g], hit.channel, hit.time_ps, [&](Window&) { close(g, events); });
+	}
+	for (auto& delayed : m_delayed) {
+		const auto close_delayed{ [&](Window& window) {
+			delayed.count += complete(delayed.group, window) ? 1U : 0U;
+			window = Window{};
+		} };
+		release(delayed, hit.time_ps, close_delayed);
+		const auto shift{ delayed.shift_ps[hit.channel] };
+		if (shift > 0) {
+			delayed.shifted[hit.channel].push_back(hit.time_ps + shift);
+		} else {
+			match(delayed.group, delayed.window, hit.channel, hit.time_ps, close_delayed);
+		}
+	}
+}
+
+template <typename Close>
+void CoincidenceEngine::release(Delayed& delayed, std::int64_t until_ps, Close&& close) {
+	// the shifted hits join the stream of the delayed window in time order. the hits of one channel are
+	// shifted by the same amount, so each queue is sorted and the oldest front is the next hit
+	while (true) {
+		std::size_t next{ stop_channels };
+		for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+			const auto& queue{ delayed.shifted[ch] };
+			if (!queue.empty() && queue.front() <= until_ps && (next == stop_channels || queue.front() < delayed.shifted[next].front())) {
+				next = ch;
+			}
+		}
+		if (next == stop_channels) {
+			return;
+		}
+		match(delayed.group, delayed.window, static_cast<std::uint8_t>(next), delayed.shifted[next].front(), close);
+		delayed.shifted[next].pop_front();
+	}
+}
+
+void CoincidenceEngine::close(std::size_t group, std::vector<CoincidenceEvent>& events) {
+	auto& window{ m_windows[group] };
+	if (complete(group, window)) {
+		m_counts[group]++;
+		CoincidenceEvent event{};
+		event.time_ps = window.first_ps;
+		event.group = static_cast<std::uint8_t>(group);
+		event.channel_mask = window.channel_mask;
+		for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+			if ((window.channel_mask & (1U << ch)) != 0) {
+				event.offset_ps[ch] = static_cast<std::int32_t>(window.time_ps[ch] - window.first_ps);
+			}
+		}
+		events.push_back(event);
+	}
+	window = Window{};
+}
+
+auto CoincidenceEngine::complete(std::size_t group, const Window& window) const->bool {
+	return window.channel_mask != 0 && bit_count(window.channel_mask) >= m_groups[group].multiplicity;
+}
+
+void CoincidenceEngine::evict(Window& window, std::int64_t oldest_ps) {
+	window.first_ps = std::numeric_limits<std::int64_t>::max();
+	for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+		const auto bit{ static_cast<std::uint8_t>(1U << ch) };
+		if ((window.channel_mask & bit) == 0) {
+			continue;
+		}
+		if (window.time_ps[ch] < oldest_ps) {
+			window.channel_mask &= static_cast<std::uint8_t>(~bit);
+			continue;
+		}
+		window.first_ps = std::min(window.first_ps, window.time_ps[ch]);
+	}
+}
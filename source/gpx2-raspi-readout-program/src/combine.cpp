@@ -0,0 +1,102 @@
+#include "combine.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+// results may arrive this much out of order between batches, like in the coincidence engine
+constexpr std::int64_t reorder_window_ps{ 1'000'000'000 };
+}
+
+ChannelCombiner::ChannelCombiner(Mode mode, std::int64_t max_interval_ps)
+	: m_mode{ mode }
+	, m_max_interval_ps{ max_interval_ps }
+{
+}
+
+void ChannelCombiner::process(std::vector<Hit>& hits, std::vector<CoincidenceEvent>& events, bool flush) {
+	m_sorter.sort(hits);
+	for (const auto& hit : hits) {
+		const std::size_t pair{ hit.channel / 2U };
+		auto& first{ m_waiting[pair][0] };
+		auto& second{ m_waiting[pair][1] };
+		(hit.channel % 2U == 0 ? first : second).push_back(hit.time_ps);
+		while (!first.empty() && !second.empty()) {
+			const std::int64_t a{ first.front() };
+			const std::int64_t b{ second.front() };
+			if (b < a) {
+				second.pop_front();
+				m_counters.unpaired++;
+				continue;
+			}
+			if (b - a > m_max_interval_ps) {
+				first.pop_front();
+				m_counters.unpaired++;
+				continue;
+			}
+			CoincidenceEvent event{};
+			event.time_ps = a;
+			event.offset_ps[2 * pair + 1] = static_cast<std::int32_t>(b - a);
+			event.group = static_cast<std::uint8_t>(pair);
+			event.channel_mask = static_cast<std::uint8_t>(0b11U << (2 * pair));
+			events.push_back(event);
+			first.pop_front();
+			second.pop_front();
+			m_counters.pairs++;
+		}
+	}
+	// results whose partner can not arrive anymore
+	if (!flush && hits.empty()) {
+		return;
+	}
+	const std::int64_t oldest{ flush ? std::numeric_limits<std::int64_t>::max() : hits.back().time_ps - m_max_interval_ps - reorder_window_ps };
+	for (auto& pair : m_waiting) {
+		for (auto& waiting : pair) {
+			while (!waiting.empty() && waiting.front() < oldest) {
+				waiting.pop_front();
+				m_counters.unpaired++;
+			}
+		}
+	}
+}
+
+auto ChannelCombiner::mode() const->Mode {
+	return m_mode;
+}
+
+auto ChannelCombiner::counters() const->const Counters& {
+	return m_counters;
+}
+
+auto ChannelCombiner::pending() const->std::size_t {
+	std::size_t n{ 0 };
+	for (const auto& pair : m_waiting) {
+		n += pair[0].size() + pair[1].size();
+	}
+	return n;
+}
+
+auto ChannelCombiner::register_value(Mode mode)->std::uint8_t {
+	constexpr std::uint8_t channel_combine_pulsedistance = 1;
+	constexpr std::uint8_t channel_combine_pulsewidth = 2;
+	switch (mode) {
+	case Mode::PulseDistance:
+		return channel_combine_pulsedistance;
+	case Mode::PulseWidth:
+		return channel_combine_pulsewidth;
+	default:
+		return 0;
+	}
+}
+
+auto ChannelCombiner::parse_mode(const std::string& name, Mode& mode)->bool {
+	if (name == "off") {
+		mode = Mode::Off;
+	} else if (name == "distance") {
+		mode = Mode::PulseDistance;
+	} else if (name == "width") {
+		mode = Mode::PulseWidth;
+	} else {
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,100 @@
+#include "control.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+ControlSocket::ControlSocket(Reactor& reactor, handler h)
+	: m_reactor{ reactor }
+	, m_handler{ std::move(h) }
+{
+}
+
+ControlSocket::~ControlSocket() {
+	for (const auto& [fd, line] : m_clients) {
+		m_reactor.remove_fd(fd);
+		close(fd);
+	}
+	if (m_listen_fd >= 0) {
+		m_reactor.remove_fd(m_listen_fd);
+		close(m_listen_fd);
+		unlink(m_path.c_str());
+	}
+}
+
+auto ControlSocket::open(const std::string& path)->bool {
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+		std::cerr << "invalid control socket path " << path << std::endl;
+		return false;
+	}
+	std::memcpy(address.sun_path, path.c_str(), path.size());
+	m_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (m_listen_fd >= 0) {
+		unlink(path.c_str());
+	}
+	if (m_listen_fd < 0 || bind(m_listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(m_listen_fd, 4) != 0) {
+		std::cerr << "could not open the control socket " << path << ": " << std::strerror(errno) << std::endl;
+		if (m_listen_fd >= 0) {
+			close(m_listen_fd);
+			m_listen_fd = -1;
+		}
+		return false;
+	}
+	m_path = path;
+	return m_reactor.add_fd(m_listen_fd, [this](std::uint32_t) { accept(); });
+}
+
+void ControlSocket::accept() {
+	while (true) {
+		const int fd{ accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC) };
+		if (fd < 0) {
+			return;
+		}
+		if (m_clients.size() >= max_clients || !m_reactor.add_fd(fd, [this, fd](std::uint32_t) { receive(fd); })) {
+			close(fd);
+			continue;
+		}
+		m_clients[fd] = {};
+	}
+}
+
+void ControlSocket::receive(int fd) {
+	char buffer[256];
+	const auto n{ recv(fd, buffer, sizeof(buffer), 0) };
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+		drop(fd);
+		return;
+	}
+	if (n < 0) {
+		return;
+	}
+	auto& line{ m_clients[fd] };
+	line.append(buffer, static_cast<std::size_t>(n));
+	std::size_t end{};
+	while ((end = line.find('\n')) != std::string::npos) {
+		std::string command{ line.substr(0, end) };
+		line.erase(0, end + 1);
+		if (!command.empty() && command.back() == '\r') {
+			command.pop_back();
+		}
+		const std::string answer{ m_handler(command) + "\n" };
+		// the answers are short, a client which does not take them is dropped
+		if (send(fd, answer.data(), answer.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(answer.size())) {
+			drop(fd);
+			return;
+		}
+	}
+	if (line.size() > max_line) {
+		drop(fd);
+	}
+}
+
+void ControlSocket::drop(int fd) {
+	m_reactor.remove_fd(fd);
+	close(fd);
+	m_clients.erase(fd);
+}
@@ -0,0 +1,248 @@
+#include "correlator.h"
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+namespace {
+auto floor_div(std::int64_t value, std::int64_t divisor)->std::int64_t {
+	const auto quotient{ value / divisor };
+	return (value % divisor != 0 && value < 0) ? quotient - 1 : quotient;
+}
+}
+
+Correlator::Correlator(Settings settings)
+	: m_settings{ settings }
+{
+	m_settings.bin_ps = std::max<std::int64_t>(m_settings.bin_ps, 1);
+	m_settings.lags = std::max<std::size_t>(m_settings.lags + m_settings.lags % 2, 2);
+	m_settings.levels = std::clamp<std::size_t>(m_settings.levels, 1, 48);
+	m_levels.resize(m_settings.levels);
+	for (auto& level : m_levels) {
+		for (auto& history : level.history) {
+			history.bins.resize(m_settings.lags);
+		}
+		level.positive.resize(m_settings.lags);
+		level.negative.resize(m_settings.lags);
+	}
+}
+
+void Correlator::add(const std::vector<Hit>& hits) {
+	// same as in the coincidence engine: merge into the hits kept back, with a scratch buffer which keeps its capacity
+	m_merged.clear();
+	std::merge(m_pending.begin(), m_pending.end(), hits.begin(), hits.end(), std::back_inserter(m_merged));
+	m_pending.swap(m_merged);
+	if (m_pending.empty()) {
+		return;
+	}
+	Hit limit{};
+	limit.time_ps = m_pending.back().time_ps - m_settings.reorder_window_ps;
+	const auto end{ std::upper_bound(m_pending.begin(), m_pending.end(), limit) };
+	for (auto it{ m_pending.begin() }; it != end; ++it) {
+		step(*it);
+	}
+	m_pending.erase(m_pending.begin(), end);
+}
+
+void Correlator::flush() {
+	for (const auto& hit : m_pending) {
+		step(hit);
+	}
+	m_pending.clear();
+}
+
+void Correlator::step(const Hit& hit) {
+	std::size_t channel{ 0 };
+	if (hit.channel == m_settings.channel_b) {
+		channel = 1;
+	} else if (hit.channel != m_settings.channel_a) {
+		return;
+	}
+	const auto index{ floor_div(hit.time_ps, m_settings.bin_ps) };
+	if (!m_started) {
+		for (std::size_t l{ 0 }; l < m_levels.size(); l++) {
+			m_levels[l].stream = index >> l;
+		}
+		m_first_ps = hit.time_ps;
+		m_started = true;
+	}
+	m_last_ps = hit.time_ps;
+	m_hits[channel]++;
+	// the bins of a level only change if the ones of the level below did
+	for (std::size_t l{ 0 }; l < m_levels.size(); l++) {
+		const auto stream{ index >> l };
+		if (stream == m_levels[l].stream) {
+			break;
+		}
+		close_bins(l, stream);
+	}
+	auto& bin{ m_levels.front().current[channel] };
+	bin.index = index;
+	bin.count++;
+}
+
+void Correlator::close_bins(std::size_t level, std::int64_t stream) {
+	auto& current{ m_levels[level].current };
+	const bool a{ current[0].count > 0 };
+	const bool b{ current[1].count > 0 };
+	// the older bin first, so the other channel finds it in its history. for the same bin a first,
+	// only the positive lags include lag 0
+	if (a && b && current[1].index < current[0].index) {
+		close(level, 1);
+		close(level, 0);
+	} else {
+		if (a) {
+			close(level, 0);
+		}
+		if (b) {
+			close(level, 1);
+		}
+	}
+	m_levels[level].stream = stream;
+}
+
+void Correlator::close(std::size_t level, std::size_t channel) {
+	auto& current{ m_levels[level] };
+	const Bin bin{ current.current[channel] };
+	current.current[channel] = Bin{};
+
+	const auto lags{ static_cast<std::int64_t>(m_settings.lags) };
+	const auto first{ static_cast<std::int64_t>(std::max<std::size_t>(first_lag(level), channel == 0 ? 1 : 0)) };
+	auto& products{ channel == 1 ? current.positive : current.negative };
+	const auto& other{ current.history[1 - channel] };
+	for (std::size_t i{ 0 }; i < other.size; i++) {
+		const auto& past{ other.bins[(other.head + i) % other.bins.size()] };
+		const auto lag{ bin.index - past.index };
+		if (lag >= first && lag < lags) {
+			products[static_cast<std::size_t>(lag)] += bin.count * past.count;
+		}
+	}
+
+	auto& history{ current.history[channel] };
+	while (history.size > 0 && (history.size == history.bins.size() || history.bins[history.head].index <= bin.index - lags)) {
+		history.head = (history.head + 1) % history.bins.size();
+		history.size--;
+	}
+	history.bins[(history.head + history.size) % history.bins.size()] = bin;
+	history.size++;
+
+	if (level + 1 < m_levels.size()) {
+		auto& up{ m_levels[level + 1].current[channel] };
+		up.index = bin.index >> 1;
+		up.count += bin.count;
+	}
+}
+
+auto Correlator::first_lag(std::size_t level) const->std::size_t {
+	return level == 0 ? 0 : m_settings.lags / 2;
+}
+
+auto Correlator::duration_ps() const->std::int64_t {
+	return m_merged_duration_ps + (m_started ? m_last_ps - m_first_ps : 0);
+}
+
+auto Correlator::g2(std::size_t level, std::size_t lag, std::uint64_t products) const->double {
+	// products expected without correlation: (bins - lag) * mean count of a * mean count of b
+	const double bins{ static_cast<double>(duration_ps()) / static_cast<double>(m_settings.bin_ps << level) };
+	const double overlap{ bins - static_cast<double>(lag) };
+	if (m_hits[0] == 0 || m_hits[1] == 0 || overlap <= 0.) {
+		return 0.;
+	}
+	return static_cast<double>(products) * bins * bins / (overlap * static_cast<double>(m_hits[0]) * static_cast<double>(m_hits[1]));
+}
+
+auto Correlator::curve() const->std::vector<Point> {
+	std::vector<Point> points{};
+	for (std::size_t l{ m_levels.size() }; l-- > 0;) {
+		for (std::size_t lag{ m_settings.lags - 1 }; lag >= std::max<std::size_t>(first_lag(l), 1); lag--) {
+			const auto products{ m_levels[l].negative[lag] };
+			points.push_back(Point{ -static_cast<std::int64_t>(lag) * (m_settings.bin_ps << l), products, g2(l, lag, products) });
+		}
+	}
+	for (std::size_t l{ 0 }; l < m_levels.size(); l++) {
+		for (std::size_t lag{ first_lag(l) }; lag < m_settings.lags; lag++) {
+			const auto products{ m_levels[l].positive[lag] };
+			points.push_back(Point{ static_cast<std::int64_t>(lag) * (m_settings.bin_ps << l), products, g2(l, lag, products) });
+		}
+	}
+	return points;
+}
+
+auto Correlator::settings() const->const Settings& {
+	return m_settings;
+}
+
+auto Correlator::merge(const Correlator& other)->bool {
+	const auto& s{ other.m_settings };
+	if (s.channel_a != m_settings.channel_a || s.channel_b != m_settings.channel_b || s.bin_ps != m_settings.bin_ps || s.lags != m_settings.lags || s.levels != m_settings.levels) {
+		return false;
+	}
+	for (std::size_t l{ 0 }; l < m_levels.size(); l++) {
+		for (std::size_t lag{ 0 }; lag < m_settings.lags; lag++) {
+			m_levels[l].positive[lag] += other.m_levels[l].positive[lag];
+			m_levels[l].negative[lag] += other.m_levels[l].negative[lag];
+		}
+	}
+	m_hits[0] += other.m_hits[0];
+	m_hits[1] += other.m_hits[1];
+	m_merged_duration_ps += other.duration_ps();
+	return true;
+}
+
+void Correlator::save(std::ostream& out) const {
+	const auto points{ curve() };
+	out << "g2 " << m_settings.channel_a + 1 << " " << m_settings.channel_b + 1 << " " << m_settings.bin_ps << " " << m_settings.lags << " " << m_settings.levels;
+	out << " " << duration_ps() << " " << m_hits[0] << " " << m_hits[1] << " " << points.size() << "\n";
+	for (const auto& point : points) {
+		out << point.lag_ps << " " << point.products << " " << point.g2 << "\n";
+	}
+}
+
+auto Correlator::load(std::istream& in, Correlator& correlator)->bool {
+	std::string line{};
+	if (!std::getline(in, line)) {
+		return false;
+	}
+	std::istringstream header{ line };
+	std::string tag{};
+	unsigned a{};
+	unsigned b{};
+	Settings settings{};
+	std::int64_t duration{};
+	std::array<std::uint64_t, 2> hits{};
+	std::size_t count{};
+	if (!(header >> tag >> a >> b >> settings.bin_ps >> settings.lags >> settings.levels >> duration >> hits[0] >> hits[1] >> count) || tag != "g2" || a < 1 || b < 1) {
+		return false;
+	}
+	settings.channel_a = static_cast<std::uint8_t>(a - 1);
+	settings.channel_b = static_cast<std::uint8_t>(b - 1);
+	Correlator loaded{ settings };
+	if (loaded.m_settings.lags != settings.lags || loaded.m_settings.levels != settings.levels) {
+		return false;
+	}
+	// the points come in the order of curve()
+	std::vector<std::uint64_t*> slots{};
+	for (std::size_t l{ loaded.m_levels.size() }; l-- > 0;) {
+		for (std::size_t lag{ settings.lags - 1 }; lag >= std::max<std::size_t>(loaded.first_lag(l), 1); lag--) {
+			slots.push_back(&loaded.m_levels[l].negative[lag]);
+		}
+	}
+	for (std::size_t l{ 0 }; l < loaded.m_levels.size(); l++) {
+		for (std::size_t lag{ loaded.first_lag(l) }; lag < settings.lags; lag++) {
+			slots.push_back(&loaded.m_levels[l].positive[lag]);
+		}
+	}
+	if (count != slots.size()) {
+		return false;
+	}
+	for (auto* slot : slots) {
+		std::int64_t lag_ps{};
+		if (!std::getline(in, line) || !(std::istringstream{ line } >> lag_ps >> *slot)) {
+			return false;
+		}
+	}
+	loaded.m_hits = hits;
+	loaded.m_merged_duration_ps = duration;
+	correlator = std::move(loaded);
+	return true;
+}
@@ -0,0 +1,173 @@
+#include "gate.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+
+namespace {
+auto clock_ns(clockid_t clock)->std::int64_t {
+	timespec ts{};
+	clock_gettime(clock, &ts);
+	return static_cast<std::int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+}
+
+HitGate::HitGate(Settings settings)
+	: m_settings{ settings }
+{
+	if (m_settings.pin < 0 && (m_settings.schedule.period_ps <= 0 || m_settings.schedule.width_ps <= 0)) {
+		m_settings.mode = Mode::Off;
+	}
+	m_settings.margin_ps = std::max<std::int64_t>(m_settings.margin_ps, 0);
+}
+
+auto HitGate::enabled() const->bool {
+	return m_settings.mode != Mode::Off;
+}
+
+auto HitGate::uses_pin() const->bool {
+	return enabled() && m_settings.pin >= 0;
+}
+
+void HitGate::set_level(bool high) {
+	m_base_active = high != m_settings.active_low;
+}
+
+void HitGate::add_edges(std::vector<gpio::event>& edges) {
+	if (edges.empty()) {
+		return;
+	}
+	// depending on the kernel the line events are stamped with the monotonic or the realtime clock,
+	// the hits are read with the monotonic one
+	const auto monotonic{ clock_ns(CLOCK_MONOTONIC) };
+	const auto realtime{ clock_ns(CLOCK_REALTIME) };
+	for (const auto& edge : edges) {
+		if (edge.type == gpio::event::Invalid) {
+			continue;
+		}
+		auto stamp{ static_cast<std::int64_t>(edge.ts.tv_sec) * 1000000000LL + edge.ts.tv_nsec };
+		if (std::llabs(realtime - stamp) < std::llabs(monotonic - stamp)) {
+			stamp += monotonic - realtime;
+		}
+		m_new_edges.push_back(Transition{ stamp, (edge.type == gpio::event::Rising) != m_settings.active_low });
+		m_counters.edges.fetch_add(1, std::memory_order_relaxed);
+	}
+	edges.clear();
+}
+
+void HitGate::apply(std::vector<Hit>& hits, std::chrono::steady_clock::time_point drain_start) {
+	if (!enabled() || hits.empty()) {
+		return;
+	}
+	if (uses_pin()) {
+		update_offset(hits, std::chrono::duration_cast<std::chrono::nanoseconds>(drain_start.time_since_epoch()).count());
+		for (const auto& edge : m_new_edges) {
+			// the offset estimate only gets better, later edges must not end up before earlier ones
+			auto time{ edge.time * 1000 - m_offset_ps };
+			if (!m_transitions.empty()) {
+				time = std::max(time, m_transitions.back().time);
+			}
+			m_transitions.push_back(Transition{ time, edge.active });
+		}
+		m_new_edges.clear();
+		// transitions before the oldest hit are only needed for the state they leave behind
+		const auto oldest{ std::min_element(hits.begin(), hits.end())->time_ps - m_settings.margin_ps };
+		while (!m_transitions.empty() && m_transitions.front().time < oldest) {
+			m_base_active = m_transitions.front().active;
+			m_transitions.pop_front();
+		}
+	}
+	const bool keep_active{ m_settings.mode == Mode::Gate };
+	const auto before{ hits.size() };
+	hits.erase(std::remove_if(hits.begin(), hits.end(), [&](const Hit& hit) { return active_near(hit.time_ps) != keep_active; }), hits.end());
+	m_counters.passed.fetch_add(hits.size(), std::memory_order_relaxed);
+	m_counters.discarded.fetch_add(before - hits.size(), std::memory_order_relaxed);
+}
+
+auto HitGate::counters() const->const Counters& {
+	return m_counters;
+}
+
+void HitGate::update_offset(const std::vector<Hit>& hits, std::int64_t drain_ns) {
+	const auto newest{ std::max_element(hits.begin(), hits.end())->time_ps };
+	const auto sample{ drain_ns * 1000 - newest };
+	if (!m_offset_known) {
+		m_block_offset_ps = sample;
+		m_previous_block_offset_ps = sample;
+		m_block_start_ns = drain_ns;
+		m_offset_known = true;
+	} else if (drain_ns - m_block_start_ns >= 1000000000LL) {
+		// the clocks drift apart, so the minimum is taken over the last one to two seconds only
+		m_previous_block_offset_ps = m_block_offset_ps;
+		m_block_offset_ps = sample;
+		m_block_start_ns = drain_ns;
+	} else {
+		m_block_offset_ps = std::min(m_block_offset_ps, sample);
+	}
+	m_offset_ps = std::min(m_block_offset_ps, m_previous_block_offset_ps);
+}
+
+auto HitGate::active_near(std::int64_t time_ps) const->bool {
+	const auto margin{ m_settings.margin_ps };
+	if (m_settings.pin < 0) {
+		const auto& schedule{ m_settings.schedule };
+		auto phase{ (time_ps - schedule.offset_ps) % schedule.period_ps };
+		if (phase < 0) {
+			phase += schedule.period_ps;
+		}
+		return phase < schedule.width_ps + margin || phase >= schedule.period_ps - margin;
+	}
+	auto it{ std::upper_bound(m_transitions.begin(), m_transitions.end(), time_ps - margin, [](std::int64_t time, const Transition& transition) { return time < transition.time; }) };
+	if (it == m_transitions.begin() ? m_base_active : std::prev(it)->active) {
+		return true;
+	}
+	// a window opening within the margin after the hit
+	for (; it != m_transitions.end() && it->time <= time_ps + margin; ++it) {
+		if (it->active) {
+			return true;
+		}
+	}
+	return false;
+}
+
+auto HitGate::parse_mode(const std::string& name, Mode& mode)->bool {
+	if (name == "gate") {
+		mode = Mode::Gate;
+	} else if (name == "veto") {
+		mode = Mode::Veto;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+auto HitGate::parse_schedule(const std::string& text, Schedule& schedule)->bool {
+	std::istringstream in{ text };
+	std::vector<double> values{};
+	for (std::string value{}; std::getline(in, value, ',');) {
+		char* end{ nullptr };
+		values.push_back(std::strtod(value.c_str(), &end));
+		if (value.empty() || *end != '\0') {
+			return false;
+		}
+	}
+	if (values.size() != 3 || values[0] <= 0. || values[2] <= 0. || values[2] > values[0]) {
+		return false;
+	}
+	schedule.period_ps = std::llround(values[0] * 1e3);
+	schedule.offset_ps = std::llround(values[1] * 1e3);
+	schedule.width_ps = std::llround(values[2] * 1e3);
+	return true;
+}
+
+auto operator<<(std::ostream& out, const HitGate::Counters& counters)->std::ostream& {
+	const auto passed{ counters.passed.load(std::memory_order_relaxed) };
+	const auto discarded{ counters.discarded.load(std::memory_order_relaxed) };
+	out << "gate passed " << passed << " hits, discarded " << discarded;
+	if (passed + discarded > 0) {
+		out << " (" << 100. * static_cast<double>(discarded) / static_cast<double>(passed + discarded) << " %)";
+	}
+	out << ", " << counters.edges.load(std::memory_order_relaxed) << " edges";
+	return out;
+}
@@ -0,0 +1,170 @@
+#include "generator.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+Random::Random(std::uint64_t seed) {
+	// splitmix64, so similar seeds give unrelated states
+	for (auto& s : m_s) {
+		seed += 0x9E3779B97F4A7C15ULL;
+		std::uint64_t z{ seed };
+		z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27U)) * 0x94D049BB133111EBULL;
+		s = z ^ (z >> 31U);
+	}
+}
+
+auto Random::exponential(double mean)->double {
+	return -std::log(uniform()) * mean;
+}
+
+auto Random::normal(double sigma)->double {
+	if (m_has_spare) {
+		m_has_spare = false;
+		return m_spare * sigma;
+	}
+	// box-muller, the second value is kept for the next call
+	constexpr double two_pi{ 6.283185307179586 };
+	const double r{ std::sqrt(-2. * std::log(uniform())) };
+	const double phi{ two_pi * uniform() };
+	m_spare = r * std::sin(phi);
+	m_has_spare = true;
+	return r * std::cos(phi) * sigma;
+}
+
+HitGenerator::HitGenerator(Settings settings)
+	: m_settings{ std::move(settings) }
+	, m_random{ m_settings.seed }
+	, m_epoch{ std::chrono::system_clock::now() }
+{
+	m_last_ps.fill(std::numeric_limits<std::int64_t>::min() / 2);
+	const auto add{ [&](Process::Kind kind, std::size_t index, double rate_hz) {
+		if (rate_hz <= 0.) {
+			return;
+		}
+		Process process{ kind, index, 1e12 / rate_hz, 0 };
+		process.next_ps = static_cast<std::int64_t>(m_random.exponential(process.mean_ps));
+		m_processes.push_back(process);
+	} };
+	for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+		add(Process::Kind::Background, ch, m_settings.background_hz[ch]);
+	}
+	for (std::size_t i{ 0 }; i < m_settings.pairs.size(); i++) {
+		add(Process::Kind::Pair, i, m_settings.pairs[i].rate_hz);
+	}
+	for (std::size_t i{ 0 }; i < m_settings.bursts.size(); i++) {
+		add(Process::Kind::Burst, i, m_settings.bursts[i].rate_hz);
+	}
+}
+
+void HitGenerator::generate(std::int64_t duration_ps, std::vector<Hit>& hits) {
+	advance(m_now_ps + duration_ps);
+	const auto period{ m_settings.refclk_period_ps };
+	const auto divisions{ static_cast<std::int64_t>(m_settings.refclk_divisions) };
+	for (const auto& e : m_ready) {
+		Hit hit{};
+		hit.ref_index = static_cast<std::uint64_t>(e.time_ps / period);
+		hit.stop_result = static_cast<std::uint32_t>(e.time_ps % period * divisions / period);
+		hit.channel = e.channel;
+		hits.push_back(hit);
+	}
+}
+
+void HitGenerator::generate(std::int64_t duration_ps, std::vector<SPI::GPX2_TDC::Meas>& measurements) {
+	advance(m_now_ps + duration_ps);
+	const auto period{ m_settings.refclk_period_ps };
+	const auto divisions{ static_cast<std::int64_t>(m_settings.refclk_divisions) };
+	const std::uint64_t ref_mask{ (std::uint64_t{ 1 } << m_settings.ref_index_bits) - 1U };
+	for (const auto& e : m_ready) {
+		SPI::GPX2_TDC::Meas meas{};
+		meas.status = SPI::GPX2_TDC::Meas::Valid;
+		meas.stop_channel = static_cast<SPI::GPX2_TDC::StopChannel>(e.channel);
+		meas.ref_index = static_cast<std::uint32_t>(static_cast<std::uint64_t>(e.time_ps / period) & ref_mask);
+		meas.stop_result = static_cast<std::uint32_t>(e.time_ps % period * divisions / period);
+		meas.lsb_ps = static_cast<double>(period) / static_cast<double>(divisions);
+		meas.refclk_freq = 1e12 / static_cast<double>(period);
+		meas.ts = m_epoch + std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds{ e.time_ps / 1000 });
+		measurements.push_back(meas);
+	}
+}
+
+auto HitGenerator::now_ps() const->std::int64_t {
+	return m_now_ps;
+}
+
+auto HitGenerator::generated() const->std::uint64_t {
+	return m_generated;
+}
+
+auto HitGenerator::lost_to_dead_time() const->std::uint64_t {
+	return m_dead;
+}
+
+void HitGenerator::advance(std::int64_t end_ps) {
+	for (auto& process : m_processes) {
+		while (process.next_ps < end_ps) {
+			emit(process, process.next_ps);
+			process.next_ps += static_cast<std::int64_t>(m_random.exponential(process.mean_ps)) + 1;
+		}
+	}
+	// stops of pairs and the tails of bursts may lie beyond the end, they are kept for the next call.
+	// both steps are stable, so hits at the same time keep the order they were emitted in with every standard
+	// library, which also decides which of them the dead time drops
+	const auto later{ std::stable_partition(m_pending.begin(), m_pending.end(), [end_ps](const Emission& e) { return e.time_ps < end_ps; }) };
+	std::stable_sort(m_pending.begin(), later, [](const Emission& a, const Emission& b) { return a.time_ps < b.time_ps; });
+	m_ready.clear();
+	for (auto it{ m_pending.begin() }; it != later; ++it) {
+		auto& last{ m_last_ps[it->channel] };
+		if (it->time_ps - last < m_settings.dead_time_ps) {
+			m_dead++;
+			continue;
+		}
+		last = it->time_ps;
+		m_ready.push_back(*it);
+	}
+	m_pending.erase(m_pending.begin(), later);
+	m_generated += m_ready.size();
+	m_now_ps = end_ps;
+}
+
+void HitGenerator::emit(const Process& process, std::int64_t time_ps) {
+	switch (process.kind) {
+	case Process::Kind::Background:
+		m_pending.push_back({ time_ps, static_cast<std::uint8_t>(process.index) });
+		break;
+	case Process::Kind::Pair: {
+		const auto& pair{ m_settings.pairs[process.index] };
+		m_pending.push_back({ time_ps, pair.start });
+		m_pending.push_back({ time_ps + interval(pair), pair.stop });
+		break;
+	}
+	case Process::Kind::Burst: {
+		const auto& burst{ m_settings.bursts[process.index] };
+		auto t{ time_ps };
+		for (unsigned i{ 0 }; i < burst.hits; i++) {
+			m_pending.push_back({ t, burst.channel });
+			t += static_cast<std::int64_t>(m_random.exponential(burst.spacing_ps)) + 1;
+		}
+		break;
+	}
+	}
+}
+
+auto HitGenerator::interval(const Pair& pair)->std::int64_t {
+	double value{ pair.delay_ps };
+	switch (pair.interval) {
+	case Interval::Fixed:
+		break;
+	case Interval::Uniform:
+		value += pair.spread_ps * m_random.uniform();
+		break;
+	case Interval::Exponential:
+		value += m_random.exponential(pair.spread_ps);
+		break;
+	}
+	if (pair.jitter_ps > 0.) {
+		value += m_random.normal(pair.jitter_ps);
+	}
+	// the stop never comes before its start
+	return std::max<std::int64_t>(0, std::llround(value));
+}
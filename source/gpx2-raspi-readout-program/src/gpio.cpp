@@ -1,5 +1,5 @@
 #include "gpio.h"
-#include <shared_mutex>
+#include "logger.h"
 #include <vector>
 #include <algorithm>
 #include <chrono>
@@ -8,7 +8,9 @@
 #include <iostream>
 #include <condition_variable>
 #include <gpiod.h>
+#include <cerrno>
 #include <ctime>
+#include <thread>
 
 void gpio::start()
 {
@@ -38,9 +40,48 @@ void gpio::start()
 	});
 }
 
+auto gpio::attach(Reactor& reactor) -> int
+{
+	if (m_result.valid() || m_reactor != nullptr) {
+		std::cout << "gpio manager already started\n";
+		return -1;
+	}
+	auto result{ setup() };
+	if (result != 0) {
+		return result;
+	}
+	m_reactor = &reactor;
+	if (lines == nullptr) {
+		return 0;
+	}
+	for (unsigned i = 0; i < gpiod_line_bulk_num_lines(lines); i++) {
+		gpiod_line* line = gpiod_line_bulk_get_line(lines, i);
+		const int fd = gpiod_line_event_get_fd(line);
+		if (!reactor.add_fd(fd, [this, line](std::uint32_t) {
+			if (read_line_events(line) != 0) {
+				m_run = false;
+			}
+		})) {
+			std::cerr << "could not add gpio line " << gpiod_line_offset(line) << " to the reactor" << std::endl;
+			stop();
+			return -1;
+		}
+		m_event_fds.push_back(fd);
+	}
+	return 0;
+}
+
 void gpio::stop()
 {
 	m_run = false;
+	if (m_reactor != nullptr) {
+		for (auto fd : m_event_fds) {
+			m_reactor->remove_fd(fd);
+		}
+		m_event_fds.clear();
+		m_reactor = nullptr;
+		[[maybe_unused]] auto result = shutdown();
+	}
 }
 
 void gpio::join()
@@ -54,8 +95,8 @@ void gpio::join()
 
 gpio::~gpio()
 {
+	stop();
 	if (m_result.valid()) {
-		stop();
 		m_result.wait();
 	}
 }
@@ -63,7 +104,7 @@ gpio::~gpio()
 
 auto gpio::list_callback(setting s) -> std::shared_ptr<callback>
 {
-	if (m_result.valid()) {
+	if (m_result.valid() || m_reactor != nullptr) {
 		return nullptr;
 	}
 
@@ -81,19 +122,25 @@ void gpio::remove_callback(std::size_t id)
 		return;
 	}
 
+	for (auto& callbacks : m_dispatch) {
+		callbacks.erase(std::remove(callbacks.begin(), callbacks.end(), m_callback[id]), callbacks.end());
+	}
 	m_callback.erase(id);
 }
 
 void gpio::notify_all(event e)
 {
-	for (auto& [id, cb] : m_callback) {
+	if (e.pin >= m_dispatch.size()) {
+		return;
+	}
+	for (auto& cb : m_dispatch[e.pin]) {
 		cb->notify(e);
 	}
 }
 
 auto gpio::setting::matches(const event& e)const -> bool {
 	// if pin of the event is in m_setting gpio_pins list then it matches
-	// maybe more efficient way of doing this
+	// only used for the setup, during the event loop the dispatch table of gpio is used
 	return (std::find(gpio_pins.begin(), gpio_pins.end(), e.pin) != gpio_pins.end());
 }
 
@@ -103,22 +150,32 @@ gpio::callback::callback(setting s, gpio& handler)
 {
 }
 
-auto gpio::callback::wait_async(std::chrono::milliseconds timeout) -> std::future<event>
+auto gpio::callback::wait_async(std::chrono::milliseconds timeout) -> std::future<std::vector<event>>
 {
 	return std::async(std::launch::async, [&] {return wait(timeout); });
 }
 
-auto gpio::callback::wait(std::chrono::milliseconds timeout) -> event
+auto gpio::callback::wait(std::chrono::milliseconds timeout) -> std::vector<event>
 {
-	{
-		std::unique_lock<std::mutex> lock{ m_wait_mutex };
+	std::vector<event> events{};
+	wait(timeout, events);
+	return events;
+}
 
-		if (m_wait.wait_for(lock, timeout) == std::cv_status::timeout) {
-			return event{};
-		}
+auto gpio::callback::wait(std::chrono::milliseconds timeout, std::vector<event>& events) -> std::size_t
+{
+	if (m_events.empty()) {
+		std::unique_lock<std::mutex> lock{ m_wait_mutex };
+		m_waiting = true;
+		m_wait.wait_for(lock, timeout, [&] { return !m_events.empty(); });
+		m_waiting = false;
 	}
-	std::unique_lock<std::shared_mutex> lock{ m_access_mutex };
-	return m_event;
+	return m_events.pop(events, m_events.capacity());
+}
+
+auto gpio::callback::dropped() const -> std::uint64_t
+{
+	return m_events.dropped();
 }
 
 auto gpio::callback::write_async(const event& e) -> std::future<bool>
@@ -137,13 +194,14 @@ auto gpio::callback::read(unsigned pin_num) -> int {
 
 void gpio::callback::notify(const event& e)
 {
-	if (!m_setting.matches(e))
-	{
+	if (!m_events.push(e)) {
 		return;
 	}
-	std::unique_lock<std::shared_mutex> lock{ m_access_mutex };
-	m_event = e;
-	m_wait.notify_all();
+	// the waiting flag is set before the queue is checked, so either the waiter sees the event or we see the flag
+	if (m_waiting) {
+		std::lock_guard<std::mutex> lock{ m_wait_mutex };
+		m_wait.notify_all();
+	}
 }
 
 auto gpio::setup() -> int {
@@ -163,44 +221,63 @@ auto gpio::setup() -> int {
 	if (pins_used_by_listeners.empty()) {
 		return 0;
 	}
-	lines = new gpiod_line_bulk{};
-	gpiod_line_bulk_init(lines);
-	int status = gpiod_chip_get_lines(chip, pins_used_by_listeners.data(), pins_used_by_listeners.size(),lines);
+	m_dispatch.resize(pins_used_by_listeners.back() + 1U);
+	for (auto& [id, cb] : m_callback) {
+		for (auto pin : cb->m_setting.gpio_pins) {
+			m_dispatch[pin].push_back(cb);
+		}
+	}
+	gpiod_line_bulk_init(&m_line_storage);
+	int status = gpiod_chip_get_lines(chip, pins_used_by_listeners.data(), pins_used_by_listeners.size(), &m_line_storage);
 	if (status<0){
 		std::cerr << "Chip get lines failed" << std::endl;
 		return status;
 	}
-	status = gpiod_line_request_bulk_both_edges_events(lines, m_consumer.c_str());
+	status = gpiod_line_request_bulk_both_edges_events(&m_line_storage, m_consumer.c_str());
 	if (status<0){
 		std::cerr << "Line request bulk both edges failed" << std::endl;
 		return status;
 	}
+	lines = &m_line_storage;
 	return 0;
 }
 
 auto gpio::step() -> int
 {
-	auto* fired = new gpiod_line_bulk{};
-	gpiod_line_bulk_init(fired);
-	int status = gpiod_line_event_wait_bulk(lines, &c_wait_timeout, fired);
+	gpiod_line_bulk_init(&m_fired);
+	int status = gpiod_line_event_wait_bulk(lines, &c_wait_timeout, &m_fired);
 	if (status <= 0){
 		//  0 -> timeout
 		// -1 -> error
-		delete fired;
-		//std::cout << "leaving step, " << status << std::endl;
+		if (status < 0) {
+			static SPI::LogSite site{ "waiting for gpio line events failed, errno {}" };
+			SPI::log(site, errno);
+		}
 		return status;
 	}
-	for (unsigned i = 0; i < gpiod_line_bulk_num_lines(fired); i++){
-		gpiod_line* line = gpiod_line_bulk_get_line(fired, i);
-		gpiod_line_event gpio_e{};
-		status = gpiod_line_event_read(line, &gpio_e);
-		if (status!=0){
-			delete fired;
-			std::cout << "leaving step, line event read error" << std::endl;
+	for (unsigned i = 0; i < gpiod_line_bulk_num_lines(&m_fired); i++){
+		status = read_line_events(gpiod_line_bulk_get_line(&m_fired, i));
+		if (status != 0){
 			return status;
 		}
+	}
+	return 0;
+}
+
+auto gpio::read_line_events(gpiod_line* line) -> int
+{
+	// read all events of a burst at once instead of one per wait
+	const int n = gpiod_line_event_read_multiple(line, m_line_events.data(), m_line_events.size());
+	if (n < 0){
+		static SPI::LogSite site{ "leaving step, line event read error on line {}, errno {}" };
+		SPI::log(site, gpiod_line_offset(line), errno);
+		return n;
+	}
+	const auto pin = gpiod_line_offset(line);
+	for (int j = 0; j < n; j++) {
+		const auto& gpio_e = m_line_events[j];
 		gpio::event e;
-		e.pin = gpiod_line_offset(line);
+		e.pin = pin;
 		e.ts = gpio_e.ts;
 		if (gpio_e.event_type==GPIOD_LINE_EVENT_RISING_EDGE){
 			e.type = event::Type::Rising;
@@ -209,7 +286,6 @@ auto gpio::step() -> int
 		}
 		notify_all(e);
 	}
-	delete fired;
 	return 0;
 }
 
@@ -218,7 +294,6 @@ auto gpio::shutdown() -> int
 	if (lines != nullptr){
 		gpiod_line_request_bulk_input(lines, m_consumer.c_str());
 		gpiod_line_release_bulk(lines);
-		//delete lines;
 		lines = nullptr;
 	}
 	for (auto [id, ptr] : other_lines){
@@ -238,7 +313,7 @@ auto gpio::shutdown() -> int
 
 auto gpio::write(const gpio::event& e) -> bool
 {
-	if (!m_result.valid()) {
+	if (!m_result.valid() && m_reactor == nullptr) {
 		return false;
 	}
 	std::cout << "requested write pin " << e.pin << " to " << e.type;
@@ -254,9 +329,14 @@ auto gpio::read(unsigned pin_num) -> int
 	if (chip==nullptr) {
 		return -1;
 	}
-	if (std::find(pins_used_by_listeners.begin(), pins_used_by_listeners.end(), pin_num) != pins_used_by_listeners.end()) {
-		std::cerr << "Error: tried to read from pin that has already an active event listener." << std::endl;
-		m_run = false;
+	if (pin_num < m_dispatch.size() && !m_dispatch[pin_num].empty()) {
+		// the line is requested for edge events, its value can still be read
+		for (unsigned i = 0; lines != nullptr && i < gpiod_line_bulk_num_lines(lines); i++) {
+			gpiod_line* line = gpiod_line_bulk_get_line(lines, i);
+			if (gpiod_line_offset(line) == pin_num) {
+				return gpiod_line_get_value(line);
+			}
+		}
 		return -1;
 	}
 	gpiod_line* line = nullptr;
@@ -264,13 +344,15 @@ auto gpio::read(unsigned pin_num) -> int
 		//std::cout << other_lines.count(pin_num) << std::endl;
 		line = gpiod_chip_get_line(chip, pin_num);
 		if (!line) {
-			std::cerr << "Chip get lines failed for line " << pin_num << std::endl;
+			static SPI::LogSite site{ "Chip get lines failed for line {}" };
+			SPI::log(site, pin_num);
 			return -1;
 		}
 
 		int ret = gpiod_line_request_input(line, m_consumer.c_str());
 		if (ret < 0) {
-			std::cerr << "Request line as input failed" << std::endl;
+			static SPI::LogSite site{ "Request line {} as input failed, errno {}" };
+			SPI::log(site, pin_num, errno);
 			gpiod_line_release(line);
 			return -1;
 		}
@@ -281,7 +363,8 @@ auto gpio::read(unsigned pin_num) -> int
 	}
 	int val = gpiod_line_get_value(line);
 	if (val < 0) {
-		std::cerr << "Read line input failed" << std::endl;
+		static SPI::LogSite site{ "Read line {} input failed, errno {}" };
+		SPI::log(site, pin_num, errno);
 		other_lines.erase(pin_num);
 		gpiod_line_release(line);
 		return -1;
@@ -0,0 +1,46 @@
+#include "hit.h"
+#include <cstdint>
+#include <chrono>
+
+RefIndexUnwrapper::RefIndexUnwrapper(double refclk_freq, unsigned ref_index_bits)
+	: m_refclk_freq{ refclk_freq }
+	, m_wrap{ std::uint64_t{ 1 } << ref_index_bits }
+{
+}
+
+auto RefIndexUnwrapper::extend(std::uint32_t ref_index, std::chrono::time_point<std::chrono::system_clock> ts)->std::uint64_t {
+	if (!m_initialised) {
+		m_initialised = true;
+		m_last = ref_index;
+		m_last_ts = ts;
+		return m_last;
+	}
+	// estimate where the reference counter should be by now and choose the wrap closest to it
+	std::uint64_t expected{ m_last };
+	if (ts > m_last_ts) {
+		const double elapsed = std::chrono::duration<double>(ts - m_last_ts).count();
+		expected += static_cast<std::uint64_t>(elapsed * m_refclk_freq);
+	}
+	auto delta = static_cast<std::int64_t>((ref_index - expected) & (m_wrap - 1U));
+	if (delta >= static_cast<std::int64_t>(m_wrap / 2U)) {
+		delta -= static_cast<std::int64_t>(m_wrap);
+	}
+	if (delta < 0 && static_cast<std::uint64_t>(-delta) > expected) {
+		// hit before the first seen reference index, can only happen directly after start
+		return ref_index;
+	}
+	const std::uint64_t extended{ static_cast<std::uint64_t>(static_cast<std::int64_t>(expected) + delta) };
+	if (extended > m_last) {
+		m_last = extended;
+		m_last_ts = ts;
+	}
+	return extended;
+}
+
+auto to_hit(const SPI::GPX2_TDC::Meas& meas, std::uint64_t extended_ref_index)->Hit {
+	Hit hit{};
+	hit.ref_index = extended_ref_index;
+	hit.stop_result = meas.stop_result;
+	hit.channel = static_cast<std::uint8_t>(meas.stop_channel);
+	return hit;
+}
@@ -0,0 +1,143 @@
+#include "hit_queue.h"
+#include <algorithm>
+
+HitQueue::HitQueue(Settings settings)
+	: m_settings{ settings }
+{
+	m_settings.chunk_hits = std::max<std::size_t>(m_settings.chunk_hits, 1);
+	const std::size_t chunks{ std::max<std::size_t>(m_settings.memory_budget / (m_settings.chunk_hits * sizeof(Hit)), 2) };
+	m_storage.resize(chunks * m_settings.chunk_hits);
+	m_fill.assign(chunks, 0);
+	m_ring.assign(chunks, 0);
+	m_free.reserve(chunks);
+	m_taken.reserve(chunks);
+	for (std::size_t i{ chunks }; i > 0; i--) {
+		m_free.push_back(i - 1);
+	}
+}
+
+auto HitQueue::push(const std::vector<Hit>& hits, const std::atomic<bool>& run)->std::size_t {
+	std::unique_lock<std::mutex> lock{ m_mutex };
+	const std::size_t chunks{ m_ring.size() };
+	for (std::size_t i{ 0 }; i < hits.size();) {
+		if (m_count == 0 || m_fill[m_ring[(m_head + m_count - 1) % chunks]] == m_settings.chunk_hits) {
+			if (!acquire_chunk(lock, run)) {
+				m_counters.dropped_newest.fetch_add(hits.size() - i, std::memory_order_relaxed);
+				break;
+			}
+		}
+		if (m_size == 0) {
+			m_since = std::chrono::steady_clock::now();
+		}
+		const std::size_t chunk{ m_ring[(m_head + m_count - 1) % chunks] };
+		auto& fill{ m_fill[chunk] };
+		const std::size_t n{ std::min(hits.size() - i, m_settings.chunk_hits - fill) };
+		std::copy_n(hits.begin() + static_cast<std::ptrdiff_t>(i), n, m_storage.begin() + static_cast<std::ptrdiff_t>(chunk * m_settings.chunk_hits + fill));
+		fill += n;
+		m_size += n;
+		i += n;
+	}
+	return m_size;
+}
+
+auto HitQueue::pop_all(std::vector<Hit>& out, std::chrono::steady_clock::time_point& since)->std::size_t {
+	std::size_t n{ 0 };
+	m_taken.clear();
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		since = m_since;
+		n = m_size;
+		const std::size_t chunks{ m_ring.size() };
+		for (std::size_t c{ 0 }; c < m_count; c++) {
+			m_taken.push_back(m_ring[(m_head + c) % chunks]);
+		}
+		m_head = 0;
+		m_count = 0;
+		m_size = 0;
+	}
+	// push only touches chunks of the ring, so the taken ones can be read without the lock
+	out.reserve(out.size() + n);
+	for (const auto chunk : m_taken) {
+		const auto first{ m_storage.begin() + static_cast<std::ptrdiff_t>(chunk * m_settings.chunk_hits) };
+		out.insert(out.end(), first, first + static_cast<std::ptrdiff_t>(m_fill[chunk]));
+	}
+	if (!m_taken.empty()) {
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			for (const auto chunk : m_taken) {
+				m_fill[chunk] = 0;
+				m_free.push_back(chunk);
+			}
+		}
+		m_space.notify_all();
+	}
+	return n;
+}
+
+auto HitQueue::size() const->std::size_t {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	return m_size;
+}
+
+auto HitQueue::capacity() const->std::size_t {
+	return m_storage.size();
+}
+
+auto HitQueue::counters() const->const Counters& {
+	return m_counters;
+}
+
+auto HitQueue::parse_overflow(const std::string& name, Overflow& overflow)->bool {
+	if (name == "block") {
+		overflow = Overflow::Block;
+	} else if (name == "drop-oldest") {
+		overflow = Overflow::DropOldest;
+	} else if (name == "drop-newest") {
+		overflow = Overflow::DropNewest;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+auto HitQueue::acquire_chunk(std::unique_lock<std::mutex>& lock, const std::atomic<bool>& run)->bool {
+	// appends a free chunk to the ring, false if the hits have to be dropped
+	const std::size_t chunks{ m_ring.size() };
+	if (m_free.empty()) {
+		m_counters.overflows.fetch_add(1U, std::memory_order_relaxed);
+		switch (m_settings.overflow) {
+		case Overflow::DropOldest:
+			if (m_count > 0) {
+				const std::size_t oldest{ m_ring[m_head] };
+				m_head = (m_head + 1) % chunks;
+				m_count--;
+				m_counters.dropped_oldest.fetch_add(m_fill[oldest], std::memory_order_relaxed);
+				m_size -= m_fill[oldest];
+				m_fill[oldest] = 0;
+				m_free.push_back(oldest);
+				break;
+			}
+			// nothing queued, pop_all is copying every chunk and returns them shortly
+			[[fallthrough]];
+		case Overflow::Block: {
+			const auto start{ std::chrono::steady_clock::now() };
+			while (m_free.empty() && run) {
+				m_space.wait_for(lock, std::chrono::milliseconds{ 10 });
+			}
+			m_counters.blocked_ns.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()), std::memory_order_relaxed);
+			if (m_free.empty()) {
+				return false;
+			}
+			break;
+		}
+		case Overflow::DropNewest:
+			return false;
+		}
+	}
+	const std::size_t chunk{ m_free.back() };
+	m_free.pop_back();
+	m_fill[chunk] = 0;
+	m_ring[(m_head + m_count) % chunks] = chunk;
+	m_count++;
+	return true;
+}
@@ -0,0 +1,161 @@
+#include "lvds.h"
+#include <algorithm>
+#include <bitset>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+LvdsSource::LvdsSource(Settings settings)
+	: m_settings{ std::move(settings) }
+{
+	m_settings.ref_index_bits = std::min(m_settings.ref_index_bits, 24U);
+	m_settings.stop_result_bits = std::clamp(m_settings.stop_result_bits, 1U, 24U);
+	m_settings.read_size = std::max<std::size_t>(m_settings.read_size, 2);
+	m_word_bits = m_settings.ref_index_bits + m_settings.stop_result_bits;
+	if (m_settings.pattern == 0) {
+		for (unsigned bit{ 0 }; bit < m_word_bits; bit += 2) {
+			m_settings.pattern |= std::uint64_t{ 1 } << (m_word_bits - 1U - bit);
+		}
+	}
+	m_settings.pattern &= (std::uint64_t{ 1 } << m_word_bits) - 1U;
+}
+
+LvdsSource::~LvdsSource() {
+	if (m_owns_fd) {
+		::close(m_fd);
+	}
+}
+
+auto LvdsSource::open()->bool {
+	if (m_settings.path == "-") {
+		m_fd = STDIN_FILENO;
+	} else {
+		m_fd = ::open(m_settings.path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (m_fd < 0) {
+			std::cerr << "could not open the lvds stream " << m_settings.path << ": " << std::strerror(errno) << std::endl;
+			return false;
+		}
+		m_owns_fd = true;
+	}
+	m_buffer.resize(m_settings.read_size);
+	m_origin = std::chrono::system_clock::now();
+	return true;
+}
+
+auto LvdsSource::read(std::vector<SPI::GPX2_TDC::Meas>& measurements, std::chrono::milliseconds timeout)->bool {
+	pollfd pfd{ m_fd, POLLIN, 0 };
+	const int ready{ ::poll(&pfd, 1, static_cast<int>(timeout.count())) };
+	if (ready == 0 || (ready < 0 && errno == EINTR)) {
+		return true;
+	}
+	const auto size{ ::read(m_fd, m_buffer.data(), m_buffer.size()) };
+	if (size < 0) {
+		if (errno == EINTR || errno == EAGAIN) {
+			return true;
+		}
+		std::cerr << "could not read the lvds stream: " << std::strerror(errno) << std::endl;
+		return false;
+	}
+	if (size == 0) {
+		return false;
+	}
+	decode(m_buffer.data(), static_cast<std::size_t>(size), measurements);
+	return true;
+}
+
+void LvdsSource::decode(const std::uint8_t* data, std::size_t size, std::vector<SPI::GPX2_TDC::Meas>& measurements) {
+	if (m_samples == 0 && m_origin == std::chrono::system_clock::time_point{}) {
+		m_origin = std::chrono::system_clock::now();
+	}
+	m_read_time = std::chrono::system_clock::now();
+	const std::uint64_t bit_sample{ m_settings.sdr_second_sample ? 1U : 0U };
+	for (std::size_t i{ 0 }; i < size; i++) {
+		const auto index{ m_samples++ };
+		if (!m_settings.ddr && (index & 1U) != bit_sample) {
+			continue;
+		}
+		// between the results the lines are idle, only a new frame needs a closer look
+		if (m_active == 0 && (data[i] >> 4U) == m_frames) {
+			continue;
+		}
+		sample(data[i], measurements);
+	}
+	m_counters.bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void LvdsSource::sample(std::uint8_t value, std::vector<SPI::GPX2_TDC::Meas>& measurements) {
+	const auto frames{ static_cast<std::uint8_t>(value >> 4U) };
+	const auto starts{ static_cast<std::uint8_t>(frames & ~m_frames & 0xFU) };
+	m_frames = frames;
+	if ((starts & m_active) != 0) {
+		m_counters.resyncs.fetch_add(std::bitset<4>{ static_cast<unsigned long>(starts & m_active) }.count(), std::memory_order_relaxed);
+	}
+	m_active |= starts;
+	for (unsigned ch{ 0 }; ch < 4; ch++) {
+		const auto mask{ static_cast<std::uint8_t>(1U << ch) };
+		if ((m_active & mask) == 0) {
+			continue;
+		}
+		if ((starts & mask) != 0) {
+			m_words[ch] = 0;
+			m_bits[ch] = 0;
+		}
+		m_words[ch] = (m_words[ch] << 1U) | ((value >> ch) & 1U);
+		if (++m_bits[ch] == m_word_bits) {
+			m_active &= static_cast<std::uint8_t>(~mask);
+			complete(ch, m_words[ch], measurements);
+		}
+	}
+}
+
+void LvdsSource::complete(unsigned channel, std::uint64_t word, std::vector<SPI::GPX2_TDC::Meas>& measurements) {
+	if (m_settings.test_pattern) {
+		m_counters.pattern_words.fetch_add(1, std::memory_order_relaxed);
+		const std::bitset<64> errors{ word ^ m_settings.pattern };
+		if (errors.any()) {
+			m_counters.pattern_errors.fetch_add(1, std::memory_order_relaxed);
+			m_counters.pattern_bit_errors.fetch_add(errors.count(), std::memory_order_relaxed);
+		}
+		return;
+	}
+	const auto stop_result{ static_cast<std::uint32_t>(word & ((std::uint64_t{ 1 } << m_settings.stop_result_bits) - 1U)) };
+	if (m_settings.max_stop_result > 0 && stop_result >= m_settings.max_stop_result) {
+		m_counters.implausible.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	SPI::GPX2_TDC::Meas meas{};
+	meas.status = SPI::GPX2_TDC::Meas::Valid;
+	meas.stop_channel = static_cast<SPI::GPX2_TDC::StopChannel>(channel);
+	meas.ref_index = static_cast<std::uint32_t>(word >> m_settings.stop_result_bits);
+	meas.stop_result = stop_result;
+	if (m_settings.sample_rate_hz > 0.) {
+		// the position in the stream is the better clock, it also holds for captures replayed faster than real time
+		meas.ts = m_origin + std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::duration<double>(static_cast<double>(m_samples - 1U) / m_settings.sample_rate_hz));
+	} else {
+		meas.ts = m_read_time;
+	}
+	measurements.push_back(meas);
+	m_counters.results.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto LvdsSource::counters() const->const Counters& {
+	return m_counters;
+}
+
+auto LvdsSource::settings() const->const Settings& {
+	return m_settings;
+}
+
+auto operator<<(std::ostream& out, const LvdsSource::Counters& counters)->std::ostream& {
+	out << "lvds " << counters.bytes.load(std::memory_order_relaxed) / 1024U << " KiB, " << counters.results.load(std::memory_order_relaxed) << " results, ";
+	out << counters.resyncs.load(std::memory_order_relaxed) << " resyncs, " << counters.implausible.load(std::memory_order_relaxed) << " implausible";
+	const auto words{ counters.pattern_words.load(std::memory_order_relaxed) };
+	if (words > 0) {
+		out << ", test pattern " << words << " words, " << counters.pattern_errors.load(std::memory_order_relaxed) << " wrong, ";
+		out << counters.pattern_bit_errors.load(std::memory_order_relaxed) << " bit errors";
+	}
+	return out;
+}
@@ -1,27 +1,193 @@
 #include "readout.h"
 #include <chrono>
+#include <cmath>
 #include <csignal>
-#include <condition_variable>
-#include <mutex>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
 
-constexpr double max_interval { 200e-9 }; // maximum interval between two stop bits to count as hit
+constexpr double max_interval { 200e-9 }; // maximum interval between the stop signals of one coincidence group
 //constexpr unsigned wait_timeout { 10000 }; // if no signal from detector for wait_timeout amount of time before restarting the waiting...
 constexpr unsigned interrupt_pin { 20 }; // interrupt pin for the falling edge signal coming from GPX2 chip
 //constexpr size_t min_buffer = 200; // minimum number of events stored in buffer
 
-std::condition_variable main_run;
-void signalHandler(int signum) {
-	std::cerr << "received signal " << signum << std::endl;
-	main_run.notify_all();
+void usage(const char* name) {
+	std::cerr << "usage: " << name << " [-c calibration_file] [--code-density output_file] [--shm name] [--record file] [--serve port [--serve-overflow drop-oldest|drop-newest|disconnect]] [--combine off|distance|width [--stop1-only]] [--accidentals delay_ns,...] [--gate gate|veto (--gate-pin n [--gate-low] | --gate-schedule period,offset,width) [--gate-margin ns]] [--control socket_path] [--spi-speed hz] [--spi-calibrate file] [--watchdog ms] [--warm] [--wait spin|block|hybrid] [--spin-us n] [--latency ms] [--queue-mb n] [--overflow block|drop-oldest|drop-newest] [--stats s] [--statistics s] [--g2 file [--g2-interval s] [--g2-bin-ps n]] [--synthetic rate_hz [--seed n]] [--lvds device|file|- [--lvds-bits ref,stop] [--lvds-ddr] [--lvds-second-sample] [--lvds-rate hz] [--lvds-test [hex]] [--lvds-setup]] [-q]\n";
+	std::cerr << "  -c              load the calibration table (lsb, channel offsets, nonlinearity lut)\n";
+	std::cerr << "  --code-density  do not search coincidences, build the nonlinearity lut from all hits instead\n";
+	std::cerr << "  --shm           publish hits and coincidences in a shared memory ring (see shm_ring.h)\n";
+	std::cerr << "  --record        append hits and coincidences to a file in the compressed block format (see codec.h)\n";
+	std::cerr << "  --serve         serve hits and coincidences to subscribers over tcp on this port (see gpx2-receive)\n";
+	std::cerr << "  --serve-overflow what happens to the frames of a subscriber which does not keep up, default drop-oldest\n";
+	std::cerr << "  --combine       channel combine mode of the chip, the intervals of stop 1 and stop 3 come from the chip instead of the coincidence search\n";
+	std::cerr << "  --stop1-only    with --combine, only stop 1 is used and only its two result registers are read\n";
+	std::cerr << "  --accidentals   count the accidental coincidences in delayed windows with these delays, longer than the window\n";
+	std::cerr << "  --gate          only keep hits inside the gate windows or discard the ones inside veto windows, before they are queued\n";
+	std::cerr << "  --gate-pin      the windows are open while this gpio pin is high\n";
+	std::cerr << "  --gate-low      the windows are open while the gate pin is low\n";
+	std::cerr << "  --gate-schedule periodic windows on the time line of the hits, all in ns\n";
+	std::cerr << "  --gate-margin   widens every window at both ends, for the uncertainty of the gpio time stamps\n";
+	std::cerr << "  --control       unix socket for changes while running: show, window [group] ps, stops 1,2,3,4, output text|none\n";
+	std::cerr << "  --spi-speed     spi clock in Hz, default 61035\n";
+	std::cerr << "  --spi-calibrate find the fastest reliable spi clock, the result is kept per board in this file and checked every minute\n";
+	std::cerr << "  --watchdog      period of the check and repair of the config registers while measuring, default 1000, 0 disables it\n";
+	std::cerr << "  --warm          attach to a running chip without reset, ref_index continues and stale fifo data is discarded\n";
+	std::cerr << "  --wait          how to wait for the interrupt of the gpx2, default spin\n";
+	std::cerr << "  --spin-us       initial spin budget of the hybrid wait in microseconds\n";
+	std::cerr << "  --latency       target for the time from reading a hit until its coincidences are written\n";
+	std::cerr << "  --queue-mb      memory budget of the hit queue in MiB, default 64\n";
+	std::cerr << "  --overflow      what happens to hits when the queue is full, default block\n";
+	std::cerr << "  --stats         period of the statistics on stderr in seconds, 0 to disable\n";
+	std::cerr << "  --statistics    period of the running interval and stop_result statistics per channel pair on stderr\n";
+	std::cerr << "  --g2            write the g2(tau) curves of the first and last channel of every group to this file, see gpx2-offline --g2-merge\n";
+	std::cerr << "  --g2-interval   period of the g2 snapshots in seconds, default 10\n";
+	std::cerr << "  --g2-bin-ps     shortest lag bin of the g2 curves, default 100\n";
+	std::cerr << "  --synthetic     no hardware, generate correlated pairs (1,2) and (3,4) with this total rate plus background\n";
+	std::cerr << "  --seed          seed of the synthetic hits\n";
+	std::cerr << "  --lvds          read the results from the lvds outputs sampled by an fpga, see lvds.h for the stream format\n";
+	std::cerr << "  --lvds-bits     bits of the ref_index (0 to 12 in steps of 2, or 16) and the stop result (14 to 20 in steps of 2) per lvds result, default 16,20\n";
+	std::cerr << "  --lvds-ddr      the gpx2 sends with double data rate\n";
+	std::cerr << "  --lvds-second-sample with single data rate, the bit is the second sample of every LCLK period\n";
+	std::cerr << "  --lvds-rate     samples per second of the stream, used as clock of the results, needed for captures\n";
+	std::cerr << "  --lvds-test     the gpx2 sends the lvds test pattern, count the wrong words. default pattern alternating bits\n";
+	std::cerr << "  --lvds-setup    configure the lvds outputs of the gpx2 over spi\n";
+	std::cerr << "  -q              no text output of the coincidences on stdout" << std::endl;
 }
 
-auto main()->int {
-	std::signal(SIGTERM, signalHandler);
-	std::signal(SIGQUIT, signalHandler);
-	std::signal(SIGINT, signalHandler);
-	Readout readout{max_interval, interrupt_pin};
-	std::mutex mx;
-	std::unique_lock<std::mutex> lock{mx};
-	main_run.wait(lock);
-	return 0;
+// pairs on the channels of the default groups with a fixed delay, 10 % uncorrelated background on every channel
+auto synthetic_load(double rate_hz)->HitGenerator::Settings {
+	HitGenerator::Settings generator{};
+	for (std::uint8_t start : { 0, 2 }) {
+		HitGenerator::Pair pair{};
+		pair.start = start;
+		pair.stop = start + 1U;
+		pair.rate_hz = rate_hz / 2.;
+		pair.delay_ps = 50e3;
+		pair.jitter_ps = 100.;
+		generator.pairs.push_back(pair);
+	}
+	generator.background_hz.fill(rate_hz / 10.);
+	return generator;
+}
+
+auto main(int argc, char* argv[])->int {
+	Readout::Settings settings{};
+	// the pairs (1,2) and (3,4) are the detector setup this program was written for
+	settings.groups = {
+		CoincidenceGroup::of({1, 2}, max_interval),
+		CoincidenceGroup::of({3, 4}, max_interval)
+	};
+	settings.interrupt_pin = interrupt_pin;
+	for (int i{ 1 }; i < argc; i++) {
+		const std::string arg{ argv[i] };
+		if (arg == "-c" && i + 1 < argc) {
+			settings.calibration_file = argv[++i];
+		} else if (arg == "--code-density" && i + 1 < argc) {
+			settings.code_density_file = argv[++i];
+		} else if (arg == "--shm" && i + 1 < argc) {
+			settings.shm_name = argv[++i];
+		} else if (arg == "--record" && i + 1 < argc) {
+			settings.record_file = argv[++i];
+		} else if (arg == "--serve" && i + 1 < argc) {
+			settings.net.port = argv[++i];
+		} else if (arg == "--serve-overflow" && i + 1 < argc && NetSink::parse_overflow(argv[i + 1], settings.net.overflow)) {
+			i++;
+		} else if (arg == "--combine" && i + 1 < argc && ChannelCombiner::parse_mode(argv[i + 1], settings.combine)) {
+			i++;
+		} else if (arg == "--stop1-only") {
+			settings.combine_stop3 = false;
+		} else if (arg == "--accidentals" && i + 1 < argc) {
+			std::istringstream delays{ argv[++i] };
+			for (std::string delay{}; std::getline(delays, delay, ',');) {
+				settings.accidental_delays_ps.push_back(std::llround(std::strtod(delay.c_str(), nullptr) * 1e3));
+			}
+		} else if (arg == "--gate" && i + 1 < argc && HitGate::parse_mode(argv[i + 1], settings.gate.mode)) {
+			i++;
+		} else if (arg == "--gate-pin" && i + 1 < argc) {
+			settings.gate.pin = static_cast<int>(std::strtol(argv[++i], nullptr, 10));
+		} else if (arg == "--gate-low") {
+			settings.gate.active_low = true;
+		} else if (arg == "--gate-schedule" && i + 1 < argc && HitGate::parse_schedule(argv[i + 1], settings.gate.schedule)) {
+			i++;
+		} else if (arg == "--gate-margin" && i + 1 < argc) {
+			settings.gate.margin_ps = std::llround(std::strtod(argv[++i], nullptr) * 1e3);
+		} else if (arg == "--control" && i + 1 < argc) {
+			settings.control_socket = argv[++i];
+		} else if (arg == "--spi-speed" && i + 1 < argc) {
+			settings.spi_speed = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		} else if (arg == "--spi-calibrate" && i + 1 < argc) {
+			settings.spi_calibration = true;
+			settings.spi.file = argv[++i];
+		} else if (arg == "--watchdog" && i + 1 < argc) {
+			settings.watchdog.interval = std::chrono::milliseconds{ std::strtoul(argv[++i], nullptr, 10) };
+		} else if (arg == "--warm") {
+			settings.warm_attach = true;
+		} else if (arg == "--wait" && i + 1 < argc && InterruptWait::parse_mode(argv[i + 1], settings.wait.mode)) {
+			i++;
+		} else if (arg == "--spin-us" && i + 1 < argc) {
+			settings.wait.spin_budget = std::chrono::microseconds{ std::strtoul(argv[++i], nullptr, 10) };
+		} else if (arg == "--latency" && i + 1 < argc) {
+			settings.batching.latency_target = std::chrono::milliseconds{ std::strtoul(argv[++i], nullptr, 10) };
+		} else if (arg == "--queue-mb" && i + 1 < argc) {
+			settings.queue.memory_budget = std::strtoull(argv[++i], nullptr, 10) << 20U;
+		} else if (arg == "--overflow" && i + 1 < argc && HitQueue::parse_overflow(argv[i + 1], settings.queue.overflow)) {
+			i++;
+		} else if (arg == "--stats" && i + 1 < argc) {
+			settings.stats_interval = std::chrono::seconds{ std::strtoul(argv[++i], nullptr, 10) };
+		} else if (arg == "--statistics" && i + 1 < argc) {
+			settings.statistics_interval = std::chrono::seconds{ std::strtoul(argv[++i], nullptr, 10) };
+		} else if (arg == "--g2" && i + 1 < argc) {
+			settings.g2_file = argv[++i];
+		} else if (arg == "--g2-interval" && i + 1 < argc) {
+			settings.g2_interval = std::chrono::seconds{ std::strtoul(argv[++i], nullptr, 10) };
+		} else if (arg == "--g2-bin-ps" && i + 1 < argc) {
+			settings.g2_bin_ps = std::strtoll(argv[++i], nullptr, 10);
+		} else if (arg == "--synthetic" && i + 1 < argc) {
+			settings.synthetic = true;
+			settings.generator = synthetic_load(std::strtod(argv[++i], nullptr));
+		} else if (arg == "--seed" && i + 1 < argc) {
+			settings.generator.seed = std::strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "--lvds" && i + 1 < argc) {
+			settings.lvds.path = argv[++i];
+		} else if (arg == "--lvds-bits" && i + 1 < argc) {
+			char* end{ nullptr };
+			settings.lvds.ref_index_bits = static_cast<unsigned>(std::strtoul(argv[++i], &end, 10));
+			if (*end != ',') {
+				usage(argv[0]);
+				return 1;
+			}
+			settings.lvds.stop_result_bits = static_cast<unsigned>(std::strtoul(end + 1, nullptr, 10));
+		} else if (arg == "--lvds-ddr") {
+			settings.lvds.ddr = true;
+		} else if (arg == "--lvds-second-sample") {
+			settings.lvds.sdr_second_sample = true;
+		} else if (arg == "--lvds-rate" && i + 1 < argc) {
+			settings.lvds.sample_rate_hz = std::strtod(argv[++i], nullptr);
+		} else if (arg == "--lvds-test") {
+			settings.lvds.test_pattern = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-') {
+				settings.lvds.pattern = std::strtoull(argv[++i], nullptr, 16);
+			}
+		} else if (arg == "--lvds-setup") {
+			settings.lvds_setup = true;
+		} else if (arg == "-q") {
+			settings.text_output = false;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	// gpio edges, timers and signals are all handled in the main thread
+	Reactor reactor{};
+	if (!reactor.add_signals({SIGTERM, SIGQUIT, SIGINT}, [&](int signum) {
+		std::cerr << "received signal " << signum << std::endl;
+		reactor.stop();
+	})) {
+		return 1;
+	}
+	Readout readout{settings, reactor};
+	const int result{ reactor.run() };
+	return result != 0 ? result : readout.exit_status();
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "monitor.h"
+#include <iomanip>
+
+Monitor::Monitor(std::size_t window)
+	: m_window{ window < 1 ? 1 : window }
+{
+	Snapshot start{};
+	start.time = std::chrono::steady_clock::now();
+	m_history.push_back(start);
+}
+
+auto Monitor::counters()->Counters& {
+	return m_counters;
+}
+
+auto Monitor::sample()->Sample {
+	Snapshot now{};
+	now.time = std::chrono::steady_clock::now();
+	for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+		now.hits[ch] = m_counters.hits[ch].load(std::memory_order_relaxed);
+	}
+	now.busy_ns = m_counters.busy_ns.load(std::memory_order_relaxed);
+	now.dead_ns = m_counters.dead_ns.load(std::memory_order_relaxed);
+
+	// the oldest snapshot marks the start of the sliding window
+	const Snapshot& first{ m_history.front() };
+	const auto elapsed_ns{ std::chrono::duration_cast<std::chrono::nanoseconds>(now.time - first.time).count() };
+	Sample result{};
+	result.time = now.time;
+	if (elapsed_ns > 0) {
+		const double seconds{ static_cast<double>(elapsed_ns) * 1e-9 };
+		for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+			result.rate[ch] = static_cast<double>(now.hits[ch] - first.hits[ch]) / seconds;
+		}
+		result.duty_cycle = static_cast<double>(now.busy_ns - first.busy_ns) / static_cast<double>(elapsed_ns);
+		result.dead_time = static_cast<double>(now.dead_ns - first.dead_ns) / static_cast<double>(elapsed_ns);
+	}
+	result.interrupt_backlog = m_counters.interrupt_backlog.load(std::memory_order_relaxed);
+	result.ref_gaps = m_counters.ref_gaps.load(std::memory_order_relaxed);
+	result.queue_saturated = m_counters.queue_saturated.load(std::memory_order_relaxed);
+
+	m_history.push_back(now);
+	while (m_history.size() > m_window + 1) {
+		m_history.pop_front();
+	}
+	std::lock_guard<std::mutex> lock{ m_sample_mutex };
+	m_last = result;
+	return result;
+}
+
+auto Monitor::last() const->Sample {
+	std::lock_guard<std::mutex> lock{ m_sample_mutex };
+	return m_last;
+}
+
+auto operator<<(std::ostream& out, const Monitor::Sample& sample)->std::ostream& {
+	const auto flags{ out.flags() };
+	const auto precision{ out.precision() };
+	out << "rates";
+	for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+		out << " " << ch + 1 << ":" << std::fixed << std::setprecision(1) << sample.rate[ch];
+	}
+	out << "/s, duty cycle " << std::setprecision(3) << sample.duty_cycle * 100. << "%";
+	out << ", dead time " << sample.dead_time * 100. << "%";
+	out << ", backlog " << sample.interrupt_backlog << ", ref gaps " << sample.ref_gaps << ", queue saturated " << sample.queue_saturated;
+	out.flags(flags);
+	out.precision(precision);
+	return out;
+}
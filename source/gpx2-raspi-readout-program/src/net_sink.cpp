@@ -0,0 +1,268 @@
+#include "net_sink.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+NetSink::NetSink(Settings settings, Reactor& reactor)
+	: m_settings{ std::move(settings) }
+	, m_reactor{ reactor }
+{
+}
+
+NetSink::~NetSink() {
+	for (const auto& [fd, client] : m_clients) {
+		m_reactor.remove_fd(fd);
+		close(fd);
+	}
+	if (m_listen_fd >= 0) {
+		m_reactor.remove_fd(m_listen_fd);
+		close(m_listen_fd);
+	}
+	if (m_timer_fd >= 0) {
+		m_reactor.close_fd(m_timer_fd);
+	}
+}
+
+auto NetSink::open()->bool {
+	addrinfo hints{};
+	hints.ai_family = AF_INET6;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	addrinfo* result{ nullptr };
+	if (getaddrinfo(nullptr, m_settings.port.c_str(), &hints, &result) != 0) {
+		hints.ai_family = AF_INET;
+		if (getaddrinfo(nullptr, m_settings.port.c_str(), &hints, &result) != 0) {
+			std::cerr << "invalid port " << m_settings.port << std::endl;
+			return false;
+		}
+	}
+	m_listen_fd = socket(result->ai_family, result->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, result->ai_protocol);
+	const int yes{ 1 };
+	const int no{ 0 };
+	if (m_listen_fd >= 0) {
+		setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+		if (result->ai_family == AF_INET6) {
+			// ipv4 subscribers as well
+			setsockopt(m_listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no));
+		}
+	}
+	const bool listening{ m_listen_fd >= 0 && bind(m_listen_fd, result->ai_addr, result->ai_addrlen) == 0 && listen(m_listen_fd, 8) == 0 };
+	freeaddrinfo(result);
+	if (!listening) {
+		std::cerr << "could not listen on port " << m_settings.port << ": " << std::strerror(errno) << std::endl;
+		return false;
+	}
+	if (!m_reactor.add_fd(m_listen_fd, [this](std::uint32_t) { accept(); })) {
+		return false;
+	}
+	m_timer_fd = m_reactor.add_timer(m_settings.flush_interval, [this] { seal(); });
+	return m_timer_fd >= 0;
+}
+
+auto NetSink::port() const->std::string {
+	sockaddr_storage address{};
+	socklen_t size{ sizeof(address) };
+	if (m_listen_fd < 0 || getsockname(m_listen_fd, reinterpret_cast<sockaddr*>(&address), &size) != 0) {
+		return m_settings.port;
+	}
+	const auto port{ address.ss_family == AF_INET6 ? reinterpret_cast<const sockaddr_in6*>(&address)->sin6_port : reinterpret_cast<const sockaddr_in*>(&address)->sin_port };
+	return std::to_string(ntohs(port));
+}
+
+void NetSink::write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) {
+	if (m_clients.empty()) {
+		return;
+	}
+	for (const auto& hit : hits) {
+		NetHitRecord record{};
+		record.time_ps = hit.time_ps;
+		record.ref_index = hit.ref_index;
+		record.stop_result = hit.stop_result;
+		record.channel = hit.channel;
+		m_hits.push_back(record);
+		if (pending_bytes() >= m_settings.max_frame_bytes) {
+			seal();
+		}
+	}
+	for (const auto& event : events) {
+		NetCoincidenceRecord record{};
+		record.time_ps = event.time_ps;
+		for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+			record.offset_ps[ch] = event.offset_ps[ch];
+		}
+		record.group = event.group;
+		record.channel_mask = event.channel_mask;
+		m_events.push_back(record);
+		if (pending_bytes() >= m_settings.max_frame_bytes) {
+			seal();
+		}
+	}
+}
+
+void NetSink::flush() {
+	seal();
+}
+
+auto NetSink::counters() const->Counters {
+	Counters counters{ m_counters };
+	counters.clients = m_clients.size();
+	return counters;
+}
+
+auto NetSink::parse_overflow(const std::string& name, Overflow& overflow)->bool {
+	if (name == "drop-oldest") {
+		overflow = Overflow::DropOldest;
+	} else if (name == "drop-newest") {
+		overflow = Overflow::DropNewest;
+	} else if (name == "disconnect") {
+		overflow = Overflow::Disconnect;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void NetSink::accept() {
+	while (true) {
+		const int fd{ accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC) };
+		if (fd < 0) {
+			return;
+		}
+		if (m_clients.size() >= m_settings.max_clients) {
+			std::cerr << "rejected a subscriber, " << m_clients.size() << " are connected already" << std::endl;
+			close(fd);
+			continue;
+		}
+		// the subscribers only read, anything they send is discarded. a closed connection is noticed here
+		const bool added{ m_reactor.add_fd(fd, [this, fd](std::uint32_t events) {
+			if ((events & (EPOLLERR | EPOLLHUP)) != 0) {
+				drop(fd);
+				return;
+			}
+			if ((events & EPOLLIN) != 0) {
+				std::uint8_t discard[256];
+				const auto n{ recv(fd, discard, sizeof(discard), 0) };
+				if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+					drop(fd);
+					return;
+				}
+			}
+			if ((events & EPOLLOUT) != 0) {
+				send(fd);
+			}
+		}) };
+		if (!added) {
+			close(fd);
+			continue;
+		}
+		m_clients[fd] = Client{};
+	}
+}
+
+auto NetSink::pending_bytes() const->std::size_t {
+	return m_hits.size() * sizeof(NetHitRecord) + m_events.size() * sizeof(NetCoincidenceRecord);
+}
+
+void NetSink::seal() {
+	if (m_hits.empty() && m_events.empty()) {
+		return;
+	}
+	if (m_clients.empty()) {
+		m_hits.clear();
+		m_events.clear();
+		return;
+	}
+	NetFrameHeader header{};
+	header.magic = net_magic;
+	header.version = net_version;
+	header.header_size = sizeof(NetFrameHeader);
+	header.sequence = ++m_sequence;
+	header.hits = static_cast<std::uint32_t>(m_hits.size());
+	header.events = static_cast<std::uint32_t>(m_events.size());
+	const std::size_t hit_bytes{ m_hits.size() * sizeof(NetHitRecord) };
+	const std::size_t event_bytes{ m_events.size() * sizeof(NetCoincidenceRecord) };
+	header.payload_size = static_cast<std::uint32_t>(hit_bytes + event_bytes);
+
+	// one buffer shared by the queues of all subscribers
+	auto data{ std::make_shared<std::vector<std::uint8_t>>(sizeof(header) + hit_bytes + event_bytes) };
+	std::memcpy(data->data(), &header, sizeof(header));
+	std::memcpy(data->data() + sizeof(header), m_hits.data(), hit_bytes);
+	std::memcpy(data->data() + sizeof(header) + hit_bytes, m_events.data(), event_bytes);
+	m_hits.clear();
+	m_events.clear();
+	m_counters.frames++;
+	m_counters.bytes += data->size();
+
+	const Frame frame{ std::move(data) };
+	std::vector<int> fds{};
+	for (const auto& [fd, client] : m_clients) {
+		fds.push_back(fd);
+	}
+	for (const int fd : fds) {
+		enqueue(fd, m_clients.at(fd), frame);
+	}
+}
+
+void NetSink::enqueue(int fd, Client& client, const Frame& frame) {
+	while (client.queued_bytes + frame->size() > m_settings.queue_bytes) {
+		if (m_settings.overflow == Overflow::Disconnect) {
+			m_counters.disconnects++;
+			drop(fd);
+			return;
+		}
+		// the frame which is partially sent cannot be dropped without breaking the stream
+		const bool droppable{ client.queue.size() > (client.sent > 0 ? 1U : 0U) };
+		if (m_settings.overflow == Overflow::DropNewest || !droppable) {
+			m_counters.dropped_frames++;
+			return;
+		}
+		const auto oldest{ client.queue.begin() + (client.sent > 0 ? 1 : 0) };
+		client.queued_bytes -= (*oldest)->size();
+		client.queue.erase(oldest);
+		m_counters.dropped_frames++;
+	}
+	client.queue.push_back(frame);
+	client.queued_bytes += frame->size();
+	send(fd);
+}
+
+void NetSink::send(int fd) {
+	const auto it{ m_clients.find(fd) };
+	if (it == m_clients.end()) {
+		return;
+	}
+	auto& client{ it->second };
+	while (!client.queue.empty()) {
+		const auto& frame{ *client.queue.front() };
+		const auto n{ ::send(fd, frame.data() + client.sent, frame.size() - client.sent, MSG_NOSIGNAL | MSG_DONTWAIT) };
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			drop(fd);
+			return;
+		}
+		client.sent += static_cast<std::size_t>(n);
+		if (client.sent == frame.size()) {
+			client.queued_bytes -= frame.size();
+			client.queue.pop_front();
+			client.sent = 0;
+		}
+	}
+	// wait for the socket to become writable only while data is pending
+	const bool want_write{ !client.queue.empty() };
+	if (want_write != client.want_write) {
+		client.want_write = want_write;
+		[[maybe_unused]] const auto modified{ m_reactor.modify_fd(fd, want_write ? (EPOLLIN | EPOLLOUT) : EPOLLIN) };
+	}
+}
+
+void NetSink::drop(int fd) {
+	m_reactor.remove_fd(fd);
+	close(fd);
+	m_clients.erase(fd);
+}
@@ -0,0 +1,109 @@
+#include "net_stream.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::uint32_t max_payload { 64U << 20U }; // larger frames are taken as corrupt stream
+}
+
+NetReceiver::~NetReceiver() {
+	close();
+}
+
+auto NetReceiver::connect(const std::string& host, const std::string& port)->bool {
+	close();
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* result{ nullptr };
+	const int status{ getaddrinfo(host.c_str(), port.c_str(), &hints, &result) };
+	if (status != 0) {
+		std::cerr << "could not resolve " << host << ": " << gai_strerror(status) << std::endl;
+		return false;
+	}
+	for (addrinfo* address{ result }; address != nullptr; address = address->ai_next) {
+		m_fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+		if (m_fd < 0) {
+			continue;
+		}
+		if (::connect(m_fd, address->ai_addr, address->ai_addrlen) == 0) {
+			break;
+		}
+		::close(m_fd);
+		m_fd = -1;
+	}
+	freeaddrinfo(result);
+	if (m_fd < 0) {
+		std::cerr << "could not connect to " << host << ":" << port << std::endl;
+		return false;
+	}
+	m_last_sequence = 0;
+	m_frames = 0;
+	m_lost = 0;
+	return true;
+}
+
+void NetReceiver::close() {
+	if (m_fd >= 0) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
+
+auto NetReceiver::next(std::vector<NetHitRecord>& hits, std::vector<NetCoincidenceRecord>& events)->bool {
+	NetFrameHeader header{};
+	if (!read_exact(&header, sizeof(header))) {
+		return false;
+	}
+	const std::size_t expected{ static_cast<std::size_t>(header.hits) * sizeof(NetHitRecord) + static_cast<std::size_t>(header.events) * sizeof(NetCoincidenceRecord) };
+	if (header.magic != net_magic || header.version != net_version || header.header_size != sizeof(header)
+		|| header.payload_size > max_payload || header.payload_size != expected) {
+		std::cerr << "corrupt frame in the stream" << std::endl;
+		return false;
+	}
+	m_payload.resize(header.payload_size);
+	if (!read_exact(m_payload.data(), m_payload.size())) {
+		return false;
+	}
+	if (m_last_sequence != 0 && header.sequence > m_last_sequence + 1) {
+		m_lost += header.sequence - m_last_sequence - 1;
+	}
+	m_last_sequence = header.sequence;
+	m_frames++;
+
+	const std::size_t first_hit{ hits.size() };
+	hits.resize(first_hit + header.hits);
+	std::memcpy(hits.data() + first_hit, m_payload.data(), header.hits * sizeof(NetHitRecord));
+	const std::size_t first_event{ events.size() };
+	events.resize(first_event + header.events);
+	std::memcpy(events.data() + first_event, m_payload.data() + header.hits * sizeof(NetHitRecord), header.events * sizeof(NetCoincidenceRecord));
+	return true;
+}
+
+auto NetReceiver::frames() const->std::uint64_t {
+	return m_frames;
+}
+
+auto NetReceiver::lost_frames() const->std::uint64_t {
+	return m_lost;
+}
+
+auto NetReceiver::read_exact(void* data, std::size_t size)->bool {
+	auto* bytes{ static_cast<std::uint8_t*>(data) };
+	while (size > 0 && m_fd >= 0) {
+		const auto n{ recv(m_fd, bytes, size, 0) };
+		if (n <= 0) {
+			if (n < 0 && errno != EINTR) {
+				std::cerr << "receiving failed: " << std::strerror(errno) << std::endl;
+			}
+			return false;
+		}
+		bytes += n;
+		size -= static_cast<std::size_t>(n);
+	}
+	return size == 0;
+}
@@ -0,0 +1,358 @@
+#include "analysis.h"
+#include "codec.h"
+#include "correlator.h"
+#include "generator.h"
+#include "radix_sort.h"
+#include "sink.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+
+constexpr double max_interval { 200e-9 }; // same default groups as the readout program
+
+void usage(const char* name) {
+	std::cerr << "usage: " << name << " [options] file\n";
+	std::cerr << "       " << name << " --generate file seconds rate_hz [--seed n]\n";
+	std::cerr << "       " << name << " --bench file [options]\n";
+	std::cerr << "       " << name << " --bench-sort max_hits [-t threads]\n";
+	std::cerr << "       " << name << " --g2 output_file [--g2-bin-ps n] [-c calibration_file] file\n";
+	std::cerr << "       " << name << " --g2-merge output_file input_file...\n";
+	std::cerr << "analyses a run recorded with readout --record on all cores\n";
+	std::cerr << "  -c              load the calibration table used to calculate the hit times\n";
+	std::cerr << "  -t              number of threads, default all cores\n";
+	std::cerr << "  --chunk         hits per chunk, default 4194304\n";
+	std::cerr << "  --margin-ns     overlap of the chunks, default ten times the coincidence window but at least 1 ms\n";
+	std::cerr << "  --bin-ps        bin width of the interval histograms, default 100\n";
+	std::cerr << "  -o              write the coincidences as text to this file\n";
+	std::cerr << "  --histograms    write the interval histograms as text to this file\n";
+	std::cerr << "  --generate      record a synthetic run of correlated pairs (1,2) and (3,4) plus background\n";
+	std::cerr << "  --bench         analyse the file with 1, 2, 4 ... up to -t threads and compare the results\n";
+	std::cerr << "  --g2            g2(tau) curves of the pairs (1,2) and (3,4) of a recorded run, in the format of readout --g2\n";
+	std::cerr << "  --g2-merge      add up the g2 curves of several chips or runs\n";
+	std::cerr << "  --bench-sort    compare the radix sort of the hits with std::sort on batches of 1000 ... max_hits hits" << std::endl;
+}
+
+void write_histograms(const AnalysisResult& result, const std::string& file) {
+	std::ofstream out{ file };
+	for (std::size_t a{ 0 }; a < stop_channels; a++) {
+		for (std::size_t b{ a + 1 }; b < stop_channels; b++) {
+			const auto& histogram{ result.intervals[PairStatistics::pair_index(a, b)] };
+			for (std::size_t i{ 0 }; i < histogram.counts.size(); i++) {
+				if (histogram.counts[i] > 0) {
+					out << a + 1 << "-" << b + 1 << " " << histogram.min_ps + static_cast<std::int64_t>(i) * histogram.bin_ps << " " << histogram.counts[i] << "\n";
+				}
+			}
+		}
+	}
+}
+
+auto generate(const std::string& file, double seconds, double rate_hz, std::uint64_t seed)->int {
+	HitGenerator::Settings settings{};
+	settings.seed = seed;
+	for (std::uint8_t start : { 0, 2 }) {
+		HitGenerator::Pair pair{};
+		pair.start = start;
+		pair.stop = start + 1U;
+		pair.rate_hz = rate_hz / 2.;
+		pair.delay_ps = 50e3;
+		pair.jitter_ps = 100.;
+		settings.pairs.push_back(pair);
+	}
+	settings.background_hz.fill(rate_hz / 10.);
+	HitGenerator generator{ settings };
+	std::ofstream out{ file, std::ios::binary | std::ios::trunc };
+	if (!out) {
+		std::cerr << "could not open " << file << std::endl;
+		return 1;
+	}
+	// blocks of 10 ms like the batches of a live run
+	constexpr std::int64_t block_ps{ 10'000'000'000 };
+	const auto total_ps{ static_cast<std::int64_t>(seconds * 1e12) };
+	std::vector<Hit> hits{};
+	std::vector<CoincidenceEvent> events{};
+	std::vector<std::uint8_t> block{};
+	while (generator.now_ps() < total_ps) {
+		hits.clear();
+		block.clear();
+		generator.generate(block_ps, hits);
+		encode_block(hits, events, block);
+		out.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(block.size()));
+	}
+	std::cerr << generator.generated() << " hits written to " << file << std::endl;
+	return 0;
+}
+
+auto bench(OfflineAnalysis::Settings settings, const std::string& file)->int {
+	const unsigned max_threads{ std::max(settings.threads, 1U) };
+	AnalysisResult reference{};
+	double single{};
+	for (unsigned threads{ 1 };; threads *= 2) {
+		threads = std::min(threads, max_threads);
+		settings.threads = threads;
+		OfflineAnalysis analysis{ settings };
+		AnalysisResult result{};
+		const auto start{ std::chrono::steady_clock::now() };
+		if (!analysis.run(file, result)) {
+			return 1;
+		}
+		const double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+		if (threads == 1) {
+			reference = result;
+			single = seconds;
+		}
+		const bool same{ result.hits == reference.hits && result.events == reference.events && result.checksum == reference.checksum };
+		std::cout << threads << " threads: " << seconds << " s, " << static_cast<double>(result.hits) / seconds * 1e-6 << " Mhits/s, speedup " << single / seconds;
+		std::cout << (same ? "" : ", RESULT DIFFERS") << std::endl;
+		if (threads == max_threads) {
+			break;
+		}
+	}
+	// the chunk boundaries must not change the result either
+	settings.chunk_hits = std::numeric_limits<std::size_t>::max();
+	settings.threads = 1;
+	OfflineAnalysis whole{ settings };
+	AnalysisResult result{};
+	if (!whole.run(file, result)) {
+		return 1;
+	}
+	std::cout << "without chunks: " << result.events << " coincidences, chunked: " << reference.events;
+	std::cout << (result.checksum == reference.checksum ? ", identical" : ", DIFFERENT") << std::endl;
+	return 0;
+}
+
+// batches as they come from a replay or from several chips: the channels one after the other,
+// each in time order, and completely shuffled. the radix sort has to give the same order as std::stable_sort.
+auto bench_sort(std::size_t max_hits, unsigned threads)->int {
+	HitGenerator::Settings settings{};
+	settings.background_hz.fill(2.5e6);
+	settings.dead_time_ps = 0;
+	HitGenerator generator{ settings };
+	std::vector<Hit> generated{};
+	while (generated.size() < max_hits) {
+		generator.generate(100'000'000'000, generated);
+	}
+	generated.resize(max_hits);
+	Timing timing{};
+	timing.apply(generated);
+
+	Random random{ 1 };
+	HitSorter radix{};
+	HitSorter parallel{ HitSorter::Key::Time, threads };
+	std::vector<Hit> input{};
+	std::vector<Hit> reference{};
+	std::vector<Hit> hits{};
+	const auto same{ [](const std::vector<Hit>& a, const std::vector<Hit>& b) {
+		return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const Hit& x, const Hit& y) {
+			return x.time_ps == y.time_ps && x.channel == y.channel && x.ref_index == y.ref_index;
+		});
+	} };
+	std::cout << "hits order ns/hit: std::sort radix";
+	std::cout << (threads > 1 ? " radix_" + std::to_string(threads) + "_threads" : "") << std::endl;
+	for (std::size_t n{ 1000 }; n <= max_hits; n *= 10) {
+		for (const bool shuffled : { false, true }) {
+			input.assign(generated.begin(), generated.begin() + static_cast<std::ptrdiff_t>(n));
+			if (shuffled) {
+				for (std::size_t i{ n - 1 }; i > 0; i--) {
+					std::swap(input[i], input[random.next() % (i + 1)]);
+				}
+			} else {
+				std::stable_partition(input.begin(), input.end(), [](const Hit& hit) { return hit.channel == 0; });
+				const auto first{ std::partition_point(input.begin(), input.end(), [](const Hit& hit) { return hit.channel == 0; }) };
+				std::stable_sort(first, input.end(), [](const Hit& a, const Hit& b) { return a.channel < b.channel; });
+			}
+			reference = input;
+			std::stable_sort(reference.begin(), reference.end());
+
+			// enough repetitions for about 1e7 sorted hits per measurement
+			const std::size_t repetitions{ std::max<std::size_t>(10'000'000 / n, 1) };
+			bool correct{ true };
+			const auto measure{ [&](const auto& sort) {
+				std::chrono::nanoseconds total{};
+				for (std::size_t r{ 0 }; r < repetitions; r++) {
+					hits = input;
+					const auto start{ std::chrono::steady_clock::now() };
+					sort(hits);
+					total += std::chrono::steady_clock::now() - start;
+				}
+				return static_cast<double>(total.count()) / static_cast<double>(n * repetitions);
+			} };
+			std::cout << n << (shuffled ? " shuffled " : " by_channel ");
+			std::cout << measure([](std::vector<Hit>& h) { std::sort(h.begin(), h.end()); });
+			std::cout << " " << measure([&](std::vector<Hit>& h) { radix.sort(h); });
+			correct = correct && same(hits, reference);
+			if (threads > 1) {
+				std::cout << " " << measure([&](std::vector<Hit>& h) { parallel.sort(h); });
+				correct = correct && same(hits, reference);
+			}
+			std::cout << (correct ? "" : " RESULT DIFFERS") << std::endl;
+		}
+	}
+	return 0;
+}
+
+auto correlate(const std::string& file, const std::string& output, const Calibration& calibration, std::int64_t bin_ps)->int {
+	std::ifstream in{ file, std::ios::binary };
+	if (!in) {
+		std::cerr << "could not open " << file << std::endl;
+		return 1;
+	}
+	std::vector<Correlator> correlators{};
+	for (std::uint8_t start : { 0, 2 }) {
+		Correlator::Settings settings{};
+		settings.channel_a = start;
+		settings.channel_b = start + 1U;
+		settings.bin_ps = bin_ps;
+		correlators.emplace_back(settings);
+	}
+	Timing timing{ calibration };
+	HitSorter sorter{};
+	BlockReader reader{ in };
+	std::vector<Hit> hits{};
+	std::vector<CoincidenceEvent> events{};
+	std::uint64_t total{ 0 };
+	const auto start{ std::chrono::steady_clock::now() };
+	while (reader.next(hits, events)) {
+		timing.apply(hits);
+		sorter.sort(hits);
+		for (auto& correlator : correlators) {
+			correlator.add(hits);
+		}
+		total += hits.size();
+		hits.clear();
+		events.clear();
+	}
+	for (auto& correlator : correlators) {
+		correlator.flush();
+	}
+	const double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+	std::cerr << total << " hits correlated in " << seconds << " s, " << static_cast<double>(total) / seconds * 1e-6 << " Mhits/s" << std::endl;
+	std::ofstream out{ output, std::ios::trunc };
+	for (const auto& correlator : correlators) {
+		correlator.save(out);
+	}
+	return out ? 0 : 1;
+}
+
+auto merge_correlations(const std::string& output, const std::vector<std::string>& inputs)->int {
+	// the correlators of equal settings are added, others are kept as they are
+	std::vector<Correlator> merged{};
+	for (const auto& file : inputs) {
+		std::ifstream in{ file };
+		Correlator correlator{ Correlator::Settings{} };
+		std::size_t count{ 0 };
+		while (Correlator::load(in, correlator)) {
+			count++;
+			if (std::none_of(merged.begin(), merged.end(), [&](Correlator& existing) { return existing.merge(correlator); })) {
+				merged.push_back(correlator);
+			}
+		}
+		if (count == 0 || !in.eof()) {
+			std::cerr << "no valid g2 curves in " << file << std::endl;
+			return 1;
+		}
+	}
+	std::ofstream out{ output, std::ios::trunc };
+	for (const auto& correlator : merged) {
+		correlator.save(out);
+	}
+	return out ? 0 : 1;
+}
+
+auto main(int argc, char* argv[])->int {
+	OfflineAnalysis::Settings settings{};
+	settings.groups = {
+		CoincidenceGroup::of({1, 2}, max_interval),
+		CoincidenceGroup::of({3, 4}, max_interval)
+	};
+	std::string input{};
+	std::string events_file{};
+	std::string histogram_file{};
+	std::string calibration_file{};
+	bool run_bench{ false };
+	std::size_t sort_hits{ 0 };
+	std::string g2_file{};
+	std::int64_t g2_bin_ps{ 100 };
+	for (int i{ 1 }; i < argc; i++) {
+		const std::string arg{ argv[i] };
+		if (arg == "--g2-merge" && i + 2 < argc) {
+			return merge_correlations(argv[i + 1], std::vector<std::string>(argv + i + 2, argv + argc));
+		} else if (arg == "--g2" && i + 1 < argc) {
+			g2_file = argv[++i];
+		} else if (arg == "--g2-bin-ps" && i + 1 < argc) {
+			g2_bin_ps = std::strtoll(argv[++i], nullptr, 10);
+		} else if (arg == "--generate" && i + 3 < argc) {
+			std::uint64_t seed{ 1 };
+			if (i + 5 < argc && std::string{ argv[i + 4] } == "--seed") {
+				seed = std::strtoull(argv[i + 5], nullptr, 10);
+			}
+			return generate(argv[i + 1], std::strtod(argv[i + 2], nullptr), std::strtod(argv[i + 3], nullptr), seed);
+		} else if (arg == "--bench" && i + 1 < argc) {
+			run_bench = true;
+			input = argv[++i];
+		} else if (arg == "--bench-sort" && i + 1 < argc) {
+			sort_hits = static_cast<std::size_t>(std::strtod(argv[++i], nullptr));
+		} else if (arg == "-c" && i + 1 < argc) {
+			calibration_file = argv[++i];
+		} else if (arg == "-t" && i + 1 < argc) {
+			settings.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+		} else if (arg == "--chunk" && i + 1 < argc) {
+			settings.chunk_hits = std::strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "--margin-ns" && i + 1 < argc) {
+			settings.margin_ps = std::strtoll(argv[++i], nullptr, 10) * 1000;
+		} else if (arg == "--bin-ps" && i + 1 < argc) {
+			settings.histogram_bin_ps = std::strtoll(argv[++i], nullptr, 10);
+		} else if (arg == "-o" && i + 1 < argc) {
+			events_file = argv[++i];
+		} else if (arg == "--histograms" && i + 1 < argc) {
+			histogram_file = argv[++i];
+		} else if (input.empty() && !arg.empty() && arg[0] != '-') {
+			input = arg;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (sort_hits > 0) {
+		return bench_sort(sort_hits, settings.threads);
+	}
+	if (input.empty()) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (!calibration_file.empty() && !settings.calibration.load(calibration_file)) {
+		return 1;
+	}
+	if (run_bench) {
+		return bench(settings, input);
+	}
+	if (!g2_file.empty()) {
+		return correlate(input, g2_file, settings.calibration, g2_bin_ps);
+	}
+
+	std::ofstream events_out{};
+	if (!events_file.empty()) {
+		events_out.open(events_file);
+		if (!events_out) {
+			std::cerr << "could not open " << events_file << std::endl;
+			return 1;
+		}
+	}
+	OfflineAnalysis analysis{ settings };
+	AnalysisResult result{};
+	TextSink text{ events_out };
+	const auto write_events{ [&](const std::vector<CoincidenceEvent>& events) {
+		text.write({}, events);
+	} };
+	if (!analysis.run(input, result, events_file.empty() ? std::function<void(const std::vector<CoincidenceEvent>&)>{} : write_events)) {
+		return 1;
+	}
+	result.print(std::cout);
+	if (!histogram_file.empty()) {
+		write_histograms(result, histogram_file);
+	}
+	return 0;
+}
@@ -0,0 +1,173 @@
+#include "radix_sort.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+constexpr std::uint64_t sign_bit{ std::uint64_t{ 1 } << 63U };
+constexpr std::uint32_t stop_result_mask{ 0xffffffU };
+
+template <typename Record>
+auto digit(const Record& record, unsigned d)->std::size_t {
+	return d < 3 ? (record.low >> (8U * d)) & 0xffU : (record.high >> (8U * (d - 3))) & 0xffU;
+}
+
+// reusable barrier of a fixed number of threads, std::barrier needs c++20
+class Barrier {
+public:
+	explicit Barrier(unsigned threads)
+		: m_threads{ threads }
+	{
+	}
+
+	void wait() {
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		const auto generation{ m_generation };
+		if (++m_waiting == m_threads) {
+			m_waiting = 0;
+			m_generation++;
+			m_released.notify_all();
+			return;
+		}
+		m_released.wait(lock, [&] { return m_generation != generation; });
+	}
+
+private:
+	std::mutex m_mutex{};
+	std::condition_variable m_released{};
+	unsigned m_threads{};
+	unsigned m_waiting{ 0 };
+	std::uint64_t m_generation{ 0 };
+};
+}
+
+HitSorter::HitSorter(Key key, unsigned threads)
+	: m_key{ key }
+	, m_threads{ std::max(threads, 1U) }
+{
+}
+
+auto HitSorter::record(const Hit& hit, std::uint32_t index) const->Record {
+	if (m_key == Key::Time) {
+		return { static_cast<std::uint64_t>(hit.time_ps) ^ sign_bit, 0U, index };
+	}
+	return { hit.ref_index, hit.stop_result & stop_result_mask, index };
+}
+
+void HitSorter::sort(std::vector<Hit>& hits) {
+	const std::size_t n{ hits.size() };
+	if (n < min_radix) {
+		if (m_key == Key::Time) {
+			std::stable_sort(hits.begin(), hits.end());
+		} else {
+			std::stable_sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b) {
+				return a.ref_index < b.ref_index || (a.ref_index == b.ref_index && (a.stop_result & stop_result_mask) < (b.stop_result & stop_result_mask));
+			});
+		}
+		return;
+	}
+	m_records.resize(n);
+	m_scratch.resize(n);
+	for (std::size_t i{ 0 }; i < n; i++) {
+		m_records[i] = record(hits[i], static_cast<std::uint32_t>(i));
+	}
+	const unsigned threads{ static_cast<unsigned>(std::min<std::size_t>(m_threads, n / min_per_thread)) };
+	if (threads > 1) {
+		sort_records_parallel(n, threads);
+	} else {
+		sort_records(n);
+	}
+	m_sorted.resize(n);
+	for (std::size_t i{ 0 }; i < n; i++) {
+		m_sorted[i] = hits[m_records[i].index];
+	}
+	hits.swap(m_sorted);
+}
+
+void HitSorter::sort_records(std::size_t n) {
+	// the counts of all digits are taken in one pass, they do not change with the order
+	m_counts.assign(digits, {});
+	for (std::size_t i{ 0 }; i < n; i++) {
+		for (unsigned d{ 0 }; d < digits; d++) {
+			m_counts[d][digit(m_records[i], d)]++;
+		}
+	}
+	for (unsigned d{ 0 }; d < digits; d++) {
+		auto& counts{ m_counts[d] };
+		if (counts[digit(m_records[0], d)] == n) {
+			continue;
+		}
+		std::size_t offset{ 0 };
+		for (auto& count : counts) {
+			const std::size_t c{ count };
+			count = offset;
+			offset += c;
+		}
+		for (std::size_t i{ 0 }; i < n; i++) {
+			m_scratch[counts[digit(m_records[i], d)]++] = m_records[i];
+		}
+		m_records.swap(m_scratch);
+	}
+}
+
+void HitSorter::sort_records_parallel(std::size_t n, unsigned threads) {
+	// the workers are started once per sort, the steps of the passes are separated by a barrier.
+	// all threads see the same counts, so they agree on the skipped digits and on the buffer of each pass
+	const auto part_begin{ [&](unsigned t) { return n * t / threads; } };
+	const std::array<Record*, 2> buffers{ m_records.data(), m_scratch.data() };
+	m_counts.assign(threads, {});
+	Barrier barrier{ threads };
+	unsigned swaps{ 0 };
+	const auto work{ [&](unsigned t) {
+		unsigned passes{ 0 };
+		for (unsigned d{ 0 }; d < digits; d++) {
+			const Record* source{ buffers[passes % 2U] };
+			Record* target{ buffers[1U - passes % 2U] };
+			auto& counts{ m_counts[t] };
+			counts.fill(0);
+			for (std::size_t i{ part_begin(t) }; i < part_begin(t + 1); i++) {
+				counts[digit(source[i], d)]++;
+			}
+			barrier.wait();
+			const std::size_t first{ digit(source[0], d) };
+			std::size_t same{ 0 };
+			for (const auto& other : m_counts) {
+				same += other[first];
+			}
+			if (same != n) {
+				// the part of a thread in each bucket follows the parts of the threads before it, which keeps the sort stable
+				std::array<std::size_t, 256> offsets{};
+				std::size_t offset{ 0 };
+				for (std::size_t bucket{ 0 }; bucket < 256; bucket++) {
+					for (unsigned u{ 0 }; u < threads; u++) {
+						if (u == t) {
+							offsets[bucket] = offset;
+						}
+						offset += m_counts[u][bucket];
+					}
+				}
+				for (std::size_t i{ part_begin(t) }; i < part_begin(t + 1); i++) {
+					target[offsets[digit(source[i], d)]++] = source[i];
+				}
+				passes++;
+			}
+			// the counts are overwritten by the next pass
+			barrier.wait();
+		}
+		if (t == 0) {
+			swaps = passes;
+		}
+	} };
+	std::vector<std::thread> workers{};
+	for (unsigned t{ 1 }; t < threads; t++) {
+		workers.emplace_back(work, t);
+	}
+	work(0U);
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	if (swaps % 2U == 1U) {
+		m_records.swap(m_scratch);
+	}
+}
@@ -0,0 +1,197 @@
+#include "reactor.h"
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <iostream>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+Reactor::Reactor()
+	: m_epoll_fd{ epoll_create1(EPOLL_CLOEXEC) }
+{
+	if (m_epoll_fd < 0) {
+		std::cerr << "could not create epoll instance" << std::endl;
+		return;
+	}
+	m_stop_fd = add_event([] {});
+}
+
+Reactor::~Reactor() {
+	for (auto& [fd, entry] : m_handlers) {
+		epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+		if (entry.owned) {
+			close(fd);
+		}
+	}
+	if (m_epoll_fd >= 0) {
+		close(m_epoll_fd);
+	}
+}
+
+auto Reactor::add_fd(int fd, handler h, std::uint32_t epoll_events)->bool {
+	if (fd < 0 || m_epoll_fd < 0) {
+		return false;
+	}
+	{
+		std::lock_guard<std::mutex> lock{ m_handler_mutex };
+		m_handlers[fd] = Entry{ std::make_shared<handler>(std::move(h)) };
+	}
+	epoll_event ev{};
+	ev.events = epoll_events;
+	ev.data.fd = fd;
+	if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		std::cerr << "could not add fd " << fd << " to epoll" << std::endl;
+		std::lock_guard<std::mutex> lock{ m_handler_mutex };
+		m_handlers.erase(fd);
+		return false;
+	}
+	return true;
+}
+
+auto Reactor::add_owned_fd(int fd, handler h)->bool {
+	if (!add_fd(fd, std::move(h))) {
+		close(fd);
+		return false;
+	}
+	std::lock_guard<std::mutex> lock{ m_handler_mutex };
+	m_handlers[fd].owned = true;
+	return true;
+}
+
+void Reactor::remove_fd(int fd) {
+	epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+	std::lock_guard<std::mutex> lock{ m_handler_mutex };
+	m_handlers.erase(fd);
+}
+
+auto Reactor::modify_fd(int fd, std::uint32_t epoll_events)->bool {
+	epoll_event ev{};
+	ev.events = epoll_events;
+	ev.data.fd = fd;
+	return epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void Reactor::close_fd(int fd) {
+	remove_fd(fd);
+	close(fd);
+}
+
+auto Reactor::add_timer(std::chrono::nanoseconds period, std::function<void()> h)->int {
+	const int fd{ timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC) };
+	if (fd < 0) {
+		std::cerr << "could not create timer" << std::endl;
+		return -1;
+	}
+	if (!set_timer(fd, period)) {
+		close(fd);
+		return -1;
+	}
+	if (!add_owned_fd(fd, [fd, h = std::move(h)](std::uint32_t) {
+		std::uint64_t expirations{};
+		if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+			h();
+		}
+	})) {
+		return -1;
+	}
+	return fd;
+}
+
+auto Reactor::set_timer(int fd, std::chrono::nanoseconds period)->bool {
+	itimerspec spec{};
+	spec.it_interval.tv_sec = static_cast<time_t>(period.count() / 1'000'000'000);
+	spec.it_interval.tv_nsec = static_cast<long>(period.count() % 1'000'000'000);
+	spec.it_value = spec.it_interval;
+	if (timerfd_settime(fd, 0, &spec, nullptr) < 0) {
+		std::cerr << "could not start timer" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+auto Reactor::add_signals(std::initializer_list<int> signals, std::function<void(int)> h)->bool {
+	sigset_t mask{};
+	sigemptyset(&mask);
+	for (auto sig : signals) {
+		sigaddset(&mask, sig);
+	}
+	if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+		std::cerr << "could not block signals" << std::endl;
+		return false;
+	}
+	const int fd{ signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC) };
+	if (fd < 0) {
+		std::cerr << "could not create signalfd" << std::endl;
+		return false;
+	}
+	return add_owned_fd(fd, [fd, h = std::move(h)](std::uint32_t) {
+		signalfd_siginfo info{};
+		while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+			h(static_cast<int>(info.ssi_signo));
+		}
+	});
+}
+
+auto Reactor::add_event(std::function<void()> h)->int {
+	const int fd{ eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) };
+	if (fd < 0) {
+		std::cerr << "could not create eventfd" << std::endl;
+		return -1;
+	}
+	if (!add_owned_fd(fd, [fd, h = std::move(h)](std::uint32_t) {
+		std::uint64_t count{};
+		if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+			h();
+		}
+	})) {
+		return -1;
+	}
+	return fd;
+}
+
+void Reactor::notify(int event_fd) {
+	const std::uint64_t one{ 1 };
+	[[maybe_unused]] auto n = write(event_fd, &one, sizeof(one));
+}
+
+auto Reactor::run()->int {
+	while (m_run) {
+		if (step(std::chrono::milliseconds{ -1 }) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+auto Reactor::step(std::chrono::milliseconds timeout)->int {
+	constexpr std::size_t max_events{ 16 };
+	std::array<epoll_event, max_events> events{};
+	const int n{ epoll_wait(m_epoll_fd, events.data(), static_cast<int>(events.size()), static_cast<int>(timeout.count())) };
+	if (n < 0) {
+		if (errno == EINTR) {
+			return 0;
+		}
+		std::cerr << "epoll_wait failed" << std::endl;
+		return -1;
+	}
+	for (int i{ 0 }; i < n; i++) {
+		std::shared_ptr<handler> h{};
+		{
+			std::lock_guard<std::mutex> lock{ m_handler_mutex };
+			auto it{ m_handlers.find(events[i].data.fd) };
+			if (it == m_handlers.end()) {
+				continue;
+			}
+			h = it->second.h;
+		}
+		(*h)(events[i].events);
+	}
+	return n;
+}
+
+void Reactor::stop() {
+	m_run = false;
+	notify(m_stop_fd);
+}
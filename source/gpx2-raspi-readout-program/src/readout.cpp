@@ -1,60 +1,293 @@
 #include "readout.h"
 #include "gpio.h"
+#include "logger.h"
 #include <future>
 #include <string>
 #include <iostream>
 #include <iomanip>
 #include <queue>
 #include <cmath>
-#include <omp.h>
 #include <chrono>
 #include <csignal>
 #include <algorithm>
+#include <sstream>
 
-Readout::Readout(double max_ref_diff, unsigned interrupt_pin)
-	: m_max_interval{max_ref_diff}
-	, m_interrupt_pin{interrupt_pin}
-	, gpio_thread{
-			[&] {
-			auto result{ setup() };
-			if (result != 0) {
-				return result;
-			}
+namespace {
+auto readout_config(ChannelCombiner::Mode combine = ChannelCombiner::Mode::Off, bool stop3 = true, std::uint8_t stops = RuntimeConfig::all_stops)->SPI::GPX2_TDC::Config {
+	SPI::GPX2_TDC::Config conf{};
+	conf.loadDefaultConfig();
+	// the default config combines the channels, without a combine mode they have to be independent stops
+	conf.CHANNEL_COMBINE = ChannelCombiner::register_value(combine);
+	if (combine != ChannelCombiner::Mode::Off) {
+		if (!stop3) {
+			conf.PIN_ENA_STOP3 = 0;
+			conf.PIN_ENA_STOP4 = 0;
+			conf.HIT_ENA_STOP3 = 0;
+			conf.HIT_ENA_STOP4 = 0;
+		}
+	}
+	if ((stops & 1U) == 0) {
+		conf.PIN_ENA_STOP1 = 0;
+		conf.HIT_ENA_STOP1 = 0;
+	}
+	if ((stops & 2U) == 0) {
+		conf.PIN_ENA_STOP2 = 0;
+		conf.HIT_ENA_STOP2 = 0;
+	}
+	if ((stops & 4U) == 0) {
+		conf.PIN_ENA_STOP3 = 0;
+		conf.HIT_ENA_STOP3 = 0;
+	}
+	if ((stops & 8U) == 0) {
+		conf.PIN_ENA_STOP4 = 0;
+		conf.HIT_ENA_STOP4 = 0;
+	}
+	conf.BLOCKWISE_FIFO_READ = 1U;
+	conf.COMMON_FIFO_READ = 0U;
 
-			while (m_run) {
-				result = read_tdc();
-				if (result != 0) {
-					break;
+	//conf.PIN_ENA_STOP3 = 0;
+	//conf.PIN_ENA_STOP4 = 0;
+	//conf.HIT_ENA_STOP3 = 0;
+	//conf.HIT_ENA_STOP4 = 0;
+	return conf;
+}
+
+auto initial_runtime(const Readout::Settings& settings)->RuntimeConfig {
+	RuntimeConfig config{};
+	for (const auto& group : settings.groups) {
+		config.window_ps.push_back(group.window_ps);
+	}
+	config.text_output = settings.text_output;
+	return config;
+}
+
+auto lvds_config(SPI::GPX2_TDC::Config conf, const LvdsSource::Settings& lvds)->SPI::GPX2_TDC::Config {
+	conf.PIN_ENA_LVDS_OUT = 1;
+	conf.LVS_DOUBLE_DATA_RATE = lvds.ddr ? 1 : 0;
+	conf.LVDS_TEST_PATTERN = lvds.test_pattern ? 1 : 0;
+	// 14, 16, 18 or 20 bits
+	conf.STOP_DATA_BITWIDTH = static_cast<std::uint8_t>((lvds.stop_result_bits - 14U) / 2U) & 3U;
+	// 0 to 12 bits in steps of 2, the last code is 16 bits
+	conf.REF_INDEX_BITWIDTH = static_cast<std::uint8_t>(lvds.ref_index_bits == 16U ? 7U : lvds.ref_index_bits / 2U) & 7U;
+	return conf;
+}
+
+auto lvds_bitwidths_supported(const LvdsSource::Settings& lvds)->bool {
+	if (lvds.stop_result_bits < 14U || lvds.stop_result_bits > 20U || lvds.stop_result_bits % 2U != 0U) {
+		std::cerr << "the gpx2 sends stop results of 14, 16, 18 or 20 bits over lvds" << std::endl;
+		return false;
+	}
+	if (lvds.ref_index_bits != 16U && (lvds.ref_index_bits > 12U || lvds.ref_index_bits % 2U != 0U)) {
+		std::cerr << "the gpx2 sends a ref_index of 0, 2, 4, 6, 8, 10, 12 or 16 bits over lvds" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+auto describe(const RuntimeConfig& config)->std::string {
+	std::ostringstream out{};
+	out << "window";
+	for (std::size_t g{ 0 }; g < config.window_ps.size(); g++) {
+		out << " " << g << ":" << config.window_ps[g];
+	}
+	out << " stops";
+	char separator{ ' ' };
+	for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+		if ((config.stop_mask & (1U << ch)) != 0) {
+			out << separator << ch + 1;
+			separator = ',';
+		}
+	}
+	out << " output " << (config.text_output ? "text" : "none");
+	return out.str();
+}
+
+auto parse_integer(const std::string& text, std::int64_t& value)->bool {
+	if (text.empty()) {
+		return false;
+	}
+	char* end{ nullptr };
+	value = std::strtoll(text.c_str(), &end, 10);
+	return *end == '\0';
+}
+}
+
+Readout::Readout(Settings settings, Reactor& reactor)
+	: m_settings{std::move(settings)}
+	, m_reactor{reactor}
+	, monitor{m_settings.monitor_window}
+	, tdc_stop{m_settings.queue}
+	, batching{m_settings.batching}
+	, gate{m_settings.gate}
+	, coincidence{m_settings.groups, 1'000'000'000, m_settings.accidental_delays_ps}
+	, runtime{initial_runtime(m_settings)}
+	, code_density{m_settings.code_density_file.empty() ? nullptr : std::make_unique<CodeDensityCalibration>(readout_config().refclk_divisions())}
+	, watchdog{m_settings.watchdog}
+{
+	for (auto delay : m_settings.accidental_delays_ps) {
+		for (const auto& group : m_settings.groups) {
+			if (delay <= group.window_ps) {
+				std::cerr << "the accidentals delay of " << delay << " ps is not longer than the window, true coincidences are counted as accidentals" << std::endl;
+				break;
+			}
+		}
+	}
+	if (m_settings.combine != ChannelCombiner::Mode::Off) {
+		std::int64_t max_interval_ps{ 0 };
+		for (const auto& group : m_settings.groups) {
+			max_interval_ps = std::max(max_interval_ps, group.window_ps);
+		}
+		combiner = std::make_unique<ChannelCombiner>(m_settings.combine, max_interval_ps);
+		// without the pair of stop 3 only half of the result registers are transferred
+		read_channels = m_settings.combine_stop3 ? stop_channels : 2U;
+	}
+	processing_config = runtime.load();
+	if (!m_settings.lvds.path.empty()) {
+		auto source{ m_settings.lvds };
+		source.max_stop_result = readout_config().refclk_divisions();
+		lvds = std::make_unique<LvdsSource>(source);
+	}
+	// the text output can be switched on by the control socket, so the sink always exists
+	auto text_sink{ std::make_unique<TextSink>(std::cout) };
+	text = text_sink.get();
+	sinks.push_back(std::move(text_sink));
+	if (!m_settings.shm_name.empty()) {
+		auto shm{ std::make_unique<ShmSink>() };
+		if (!shm->open(m_settings.shm_name, m_settings.shm_capacity)) {
+			fail();
+			return;
+		}
+		sinks.push_back(std::move(shm));
+	}
+	if (!m_settings.record_file.empty()) {
+		auto file{ std::make_unique<FileSink>() };
+		if (!file->open(m_settings.record_file)) {
+			fail();
+			return;
+		}
+		sinks.push_back(std::move(file));
+	}
+	if (!m_settings.net.port.empty()) {
+		auto served{ std::make_unique<NetSink>(m_settings.net, m_reactor) };
+		if (!served->open()) {
+			fail();
+			return;
+		}
+		net = served.get();
+		sinks.push_back(std::move(served));
+	}
+	if (!m_settings.g2_file.empty()) {
+		// the first and the last channel of every group
+		std::vector<Correlator::Settings> pairs{};
+		for (const auto& group : m_settings.groups) {
+			Correlator::Settings pair{};
+			pair.bin_ps = m_settings.g2_bin_ps;
+			std::size_t channels{ 0 };
+			for (std::uint8_t ch{ 0 }; ch < stop_channels; ch++) {
+				if ((group.channel_mask & (1U << ch)) != 0) {
+					pair.channel_a = channels++ == 0 ? ch : pair.channel_a;
+					pair.channel_b = ch;
 				}
 			}
-			return result;
+			if (channels >= 2) {
+				pairs.push_back(pair);
+			}
 		}
+		auto g2{ std::make_unique<CorrelationSink>(pairs) };
+		correlation = g2.get();
+		sinks.push_back(std::move(g2));
 	}
-	,analysis_thread{
-			[&] {
-			start_time = std::chrono::high_resolution_clock::now();
-			while (m_run) {
-				std::this_thread::sleep_for(process_loop_timeout);
-				process_queue();
+	if (m_settings.statistics_interval.count() > 0) {
+		auto stats{ std::make_unique<StatisticsSink>() };
+		statistics = stats.get();
+		sinks.push_back(std::move(stats));
+	}
+	if (!m_settings.control_socket.empty()) {
+		control = std::make_unique<ControlSocket>(m_reactor, [this](const std::string& command) { return control_command(command); });
+		if (!control->open(m_settings.control_socket)) {
+			fail();
+			return;
+		}
+	}
+	start_time = std::chrono::high_resolution_clock::now();
+	last_stats_time = start_time;
+	flush_timer = m_reactor.add_timer(batching.period(), [this] { process_queue(); });
+	queue_full_event = m_reactor.add_event([this] { process_queue(); });
+	monitor_timer = m_reactor.add_timer(m_settings.monitor_interval, [this] { sample_monitor(); });
+	if (statistics != nullptr) {
+		statistics_timer = m_reactor.add_timer(m_settings.statistics_interval, [this] { print_statistics(); });
+	}
+	if (correlation != nullptr && m_settings.g2_interval.count() > 0) {
+		g2_timer = m_reactor.add_timer(m_settings.g2_interval, [this] { static_cast<void>(correlation->snapshot(m_settings.g2_file)); });
+	}
+	if (m_settings.stats_interval.count() > 0) {
+		stats_timer = m_reactor.add_timer(m_settings.stats_interval, [this] { print_stats(); });
+	}
+	acquisition_thread = std::thread{
+		[&] {
+			auto result{ lvds ? setup_lvds() : m_settings.synthetic ? setup_synthetic() : setup() };
+			while (m_run && result == 0) {
+				result = lvds ? read_lvds() : m_settings.synthetic ? read_synthetic() : read_tdc();
+				if (result == 0) {
+					result = maintain();
+				}
 			}
-			if (!tdc_stop[1].empty() && !tdc_stop[0].empty()) {
-				process_queue(true);
+			if (result < 0) {
+				fail();
+			} else if (result > 0) {
+				// nothing left to do for the program
+				m_reactor.stop();
 			}
-			end_time = std::chrono::high_resolution_clock::now();
-			auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
-			std::cerr << evt_count << " events, ";
-			std::cerr << duration << " ms, ";
-			auto rate = static_cast<double>(evt_count) / static_cast<double>(duration) * 1e6;
-			std::cerr << "rate is " << rate << "/s, " << rate * 60 << "/min, " << rate * 60 * 60 << "/h, " << rate * 60 * 60 * 24 << "/d, " << rate * 60 * 60 * 24 * 7 << "/w" << std::endl;
-			std::cerr << "non processed events in queues: " << tdc_stop[0].size() << " " << tdc_stop[1].size() << " (should not be greate than " << max_queue_size << ")" << std::endl;
-			return 0;
 		}
-	}{}
+	};
+}
 
 Readout::~Readout() {
 	stop();
-	gpio_thread.join();
-	analysis_thread.join();
+	if (acquisition_thread.joinable()) {
+		acquisition_thread.join();
+	}
+	// the final process_queue must not rearm the closed flush timer
+	for (auto* fd : { &flush_timer, &stats_timer, &monitor_timer, &statistics_timer, &g2_timer, &queue_full_event }) {
+		if (*fd >= 0) {
+			m_reactor.close_fd(*fd);
+			*fd = -1;
+		}
+	}
+	if (handler) {
+		handler->stop();
+	}
+
+	process_queue(true);
+	if (code_density) {
+		auto calibration{ timing.calibration() };
+		std::cerr << "code density calibration updated " << code_density->apply_to(calibration) << " channels" << std::endl;
+		if (!calibration.save(m_settings.code_density_file)) {
+			std::cerr << "code density calibration lost" << std::endl;
+		}
+	}
+	if (correlation != nullptr && correlation->snapshot(m_settings.g2_file)) {
+		std::cerr << "g2 curves written to " << m_settings.g2_file << std::endl;
+	}
+	if (statistics != nullptr) {
+		std::cerr << "statistics of the whole run:\n";
+		statistics->total().print(std::cerr);
+	}
+	print_accidentals();
+	if (lvds) {
+		std::cerr << lvds->counters() << std::endl;
+	}
+	end_time = std::chrono::high_resolution_clock::now();
+	auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+	std::cerr << evt_count << " events, ";
+	std::cerr << duration << " ms, ";
+	auto rate = static_cast<double>(evt_count) / static_cast<double>(duration) * 1e6;
+	std::cerr << "rate is " << rate << "/s, " << rate * 60 << "/min, " << rate * 60 * 60 << "/h, " << rate * 60 * 60 * 24 << "/d, " << rate * 60 * 60 * 24 * 7 << "/w" << std::endl;
+	std::cerr << "non processed hits in queue: " << tdc_stop.size() + coincidence.pending() + (combiner ? combiner->pending() : 0U) << std::endl;
+	const auto& queue{ tdc_stop.counters() };
+	if (queue.overflows > 0) {
+		std::cerr << "hit queue overflowed " << queue.overflows << " times, dropped " << queue.dropped_oldest + queue.dropped_newest << " hits" << std::endl;
+	}
 }
 
 void Readout::stop()
@@ -62,130 +295,505 @@ void Readout::stop()
 	m_run = false;
 }
 
+auto Readout::exit_status() const->int {
+	return m_exit_status.load();
+}
+
+void Readout::fail() {
+	m_exit_status = 1;
+	m_reactor.stop();
+}
+
 auto Readout::setup()->int {
 	if (gpx2) {
 		std::cerr << "tried to create new gpx2 device but it is already created." << std::endl;
 		return -1;
 	}
 	gpx2 = std::make_unique<SPI::GPX2_TDC::GPX2>();
-	SPI::GPX2_TDC::Config conf{};
-	conf.loadDefaultConfig();
-	conf.BLOCKWISE_FIFO_READ = 1U;
-	conf.COMMON_FIFO_READ = 0U;
+	SPI::GPX2_TDC::Config conf{ readout_config(m_settings.combine, m_settings.combine_stop3) };
 
-	//conf.PIN_ENA_STOP3 = 0;
-	//conf.PIN_ENA_STOP4 = 0;
-	//conf.HIT_ENA_STOP3 = 0;
-	//conf.HIT_ENA_STOP4 = 0;
+	auto calibration{ Calibration::from_config(conf) };
+	if (!m_settings.calibration_file.empty() && !calibration.load(m_settings.calibration_file)) {
+		return -1;
+	}
+	timing = Timing{ calibration };
 
-	gpx2->init();
+	// a warm attach skips the resets if the chip already runs with this config,
+	// so a restart of the program keeps the measurement and the ref_index timeline
+	bool measuring{ false };
+	if (m_settings.warm_attach) {
+		gpx2->open();
+		if (!set_spi_speed(gpx2->read_config(), true)) {
+			return -1;
+		}
+		const int written{ gpx2->update_config(conf) };
+		if (written < 0) {
+			std::cerr << "failed to attach to the gpx2!" << std::endl;
+			return -1;
+		}
+		measuring = (written == 0);
+		std::cerr << (measuring ? "attached to the running gpx2" : "updated " + std::to_string(written) + " config registers of the gpx2") << std::endl;
+	} else {
+		gpx2->init();
+		if (!set_spi_speed(conf.str(), false)) {
+			return -1;
+		}
 
-	int verbosity = 0;
+		int verbosity = 0;
 
-	bool status = gpx2->write_config(conf);
-	std::string config = gpx2->read_config();
-	if (status && (config == conf.str())) {
-		if (verbosity > 1) {
-			std::cerr << "config written..." << std::endl;
+		bool status = gpx2->write_config(conf);
+		std::string config = gpx2->read_config();
+		if (status && (config == conf.str())) {
+			if (verbosity > 1) {
+				std::cerr << "config written..." << std::endl;
+			}
+		}
+		else {
+			std::cerr << "tried to write:" << std::endl;
+			print_hex(conf.str());
+			std::cerr << "read back:" << std::endl;
+			print_hex(config);
+			std::cerr << "failed to write config!" << std::endl;
+			return -1;
 		}
-	}
-	else {
-		std::cerr << "tried to write:" << std::endl;
-		print_hex(conf.str());
-		std::cerr << "read back:" << std::endl;
-		print_hex(config);
-		std::cerr << "failed to write config!" << std::endl;
-		return -1;
 	}
 
 	handler = std::make_unique<gpio>();
 	gpio::setting pin_setting{};
+	// the falling edge of the interrupt pin wakes up the acquisition thread if it does not spin
+	pin_setting.gpio_pins = { m_settings.interrupt_pin };
 
 	callback = handler->list_callback(pin_setting);
+	if (gate.uses_pin()) {
+		gpio::setting gate_setting{};
+		gate_setting.gpio_pins = { static_cast<unsigned>(m_settings.gate.pin) };
+		gate_callback = handler->list_callback(gate_setting);
+	}
+
+	if (handler->attach(m_reactor) != 0) {
+		std::cerr << "failed to set up gpio" << std::endl;
+		return -1;
+	}
+	if (gate_callback) {
+		gate.set_level(gate_callback->read(static_cast<unsigned>(m_settings.gate.pin)) == 1);
+	}
+
+	chip_registers = conf.str();
+	watchdog.expect(chip_registers);
+	interrupt_wait = std::make_unique<InterruptWait>(m_settings.wait, *callback, m_settings.interrupt_pin, wait_metrics);
+
+	if (measuring) {
+		// results measured while no one was reading are discarded, their ref_index can not be extended reliably
+		const auto stale{ gpx2->discard_results() };
+		if (stale > 0) {
+			std::cerr << "discarded " << stale << " stale results from the fifos" << std::endl;
+		}
+	} else {
+		gpx2->init_reset();
+	}
+	return 0;
+}
 
-	handler->start();
+auto Readout::set_spi_speed(const std::string& registers, bool measuring)->bool {
+	if (m_settings.spi_speed > 0) {
+		gpx2->set_speed(m_settings.spi_speed);
+	}
+	if (!m_settings.spi_calibration) {
+		return true;
+	}
+	spi_speed = std::make_unique<SpiSpeed>(m_settings.spi);
+	return spi_speed->select(*gpx2, registers, measuring);
+}
 
-	gpx2->init_reset();
+auto Readout::maintain()->int {
+	// runs in the acquisition thread between two drains, so it never competes with them for the spi bus
+	if (runtime.version() != acquisition_version) {
+		acquisition_version = runtime.version();
+		const auto config{ runtime.load() };
+		if (config->stop_mask != stop_mask) {
+			stop_mask = config->stop_mask;
+			if (gpx2) {
+				enable_stops(stop_mask);
+			}
+		}
+	}
+	if (!gpx2) {
+		// synthetic hits or an lvds stream of a chip configured elsewhere
+		return 0;
+	}
+	const auto now{ std::chrono::steady_clock::now() };
+	if (spi_speed && spi_speed->check_due(now) && !spi_speed->check(*gpx2, chip_registers)) {
+		std::cerr << "lost the spi link to the gpx2" << std::endl;
+		return -1;
+	}
+	if (watchdog.due(now)) {
+		// registers which can not be repaired are logged and tried again on the next round, the acquisition goes on
+		static_cast<void>(watchdog.check(*gpx2));
+	}
 	return 0;
 }
 
+void Readout::enable_stops(std::uint8_t mask) {
+	// only the registers with the pin and hit enables change
+	auto conf{ readout_config(m_settings.combine, m_settings.combine_stop3, mask) };
+	if (lvds) {
+		conf = lvds_config(conf, lvds->settings());
+	}
+	const int written{ gpx2->update_config(conf) };
+	if (written < 0) {
+		static SPI::LogSite failed{ "could not enable the stop channel mask {} on the gpx2" };
+		SPI::log(failed, mask);
+		return;
+	}
+	chip_registers = conf.str();
+	watchdog.expect(chip_registers);
+	std::cerr << "stop channel mask " << static_cast<unsigned>(mask) << " set with " << written << " register writes" << std::endl;
+}
+
 auto Readout::read_tdc()->int {
 	// checks if data is available on the gpx2 (by checking if interrupt pin is low)
 	// then reads out data from the gpx2-tdc and puts it in the queue
-	while (callback->read(m_interrupt_pin) != 0) {
-		// while interrupt pin is high, do not readout (since there is no data available)
-		// std::this_thread::sleep_for(std::chrono::microseconds(1));
+	// while interrupt pin is high, do not readout (since there is no data available)
+	const auto wake{ interrupt_wait->wait(m_run) };
+	if (wake == InterruptWait::Wake::Stopped) {
+		return 0;
+	}
+	auto& counters{ monitor.counters() };
+	const auto drain_start{ std::chrono::steady_clock::now() };
+	if (wake == InterruptWait::Wake::Immediate && counters.drains.load(std::memory_order_relaxed) > 0) {
+		// the interrupt is still asserted after the last drain: the readout lags behind the chip
+		// and the fifos may have overflown since then
+		counters.interrupt_backlog.fetch_add(1U, std::memory_order_relaxed);
+		counters.dead_ns.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(drain_start - last_drain).count()), std::memory_order_relaxed);
 	}
+	last_drain = drain_start;
+	drain_hits.clear();
 	for (unsigned i = 0; i < 4; i++) {
 		auto now = std::chrono::system_clock::now();
-		auto measurements = gpx2->read_results();
-		for (unsigned j = 0; j < 4; j++) {
-			if (measurements[j]) {
-				measurements[j].ts = now;
-				tdc_stop[j%2].emplace(std::move(measurements[j]));
+		auto measurements = gpx2->read_results(read_channels);
+		for (auto& meas : measurements) {
+			if (meas) {
+				drain_hits.push_back(to_hit(meas, unwrapper.extend(meas.ref_index, now)));
 			}
 		}
 	}
-	queue_condition.notify_all();
+	enqueue(drain_hits, drain_start);
+	counters.drains.fetch_add(1U, std::memory_order_relaxed);
+	counters.busy_ns.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - drain_start).count()), std::memory_order_relaxed);
+	return 0;
+}
+
+auto Readout::setup_synthetic()->int {
+	if (gate.uses_pin()) {
+		std::cerr << "a gate pin needs the gpx2 hardware, use a gate schedule with synthetic hits" << std::endl;
+		return -1;
+	}
+	auto calibration{ Calibration::from_config(readout_config()) };
+	if (!m_settings.calibration_file.empty() && !calibration.load(m_settings.calibration_file)) {
+		return -1;
+	}
+	timing = Timing{ calibration };
+	auto settings{ m_settings.generator };
+	settings.refclk_period_ps = calibration.refclk_period_ps;
+	settings.refclk_divisions = calibration.refclk_divisions;
+	generator = std::make_unique<HitGenerator>(settings);
+	generator_time = std::chrono::steady_clock::now();
+	return 0;
+}
+
+auto Readout::read_synthetic()->int {
+	// generates the hits of the time passed since the last call, so the pipeline sees the configured rates
+	std::this_thread::sleep_for(synthetic_period);
+	const auto now{ std::chrono::steady_clock::now() };
+	const auto elapsed_ps{ std::chrono::duration_cast<std::chrono::nanoseconds>(now - generator_time).count() * 1000 };
+	generator_time = now;
+	synthetic_measurements.clear();
+	generator->generate(elapsed_ps, synthetic_measurements);
+	const auto ts{ std::chrono::system_clock::now() };
+	drain_hits.clear();
+	for (const auto& meas : synthetic_measurements) {
+		drain_hits.push_back(to_hit(meas, unwrapper.extend(meas.ref_index, ts)));
+	}
+	enqueue(drain_hits, now);
+	monitor.counters().drains.fetch_add(1U, std::memory_order_relaxed);
+	return 0;
+}
+
+auto Readout::setup_lvds()->int {
+	if (gate.uses_pin()) {
+		std::cerr << "a gate pin is not supported with the lvds readout, use a gate schedule" << std::endl;
+		return -1;
+	}
+	const auto& settings{ lvds->settings() };
+	// also for a chip configured elsewhere, other widths can not be its stream
+	if (!lvds_bitwidths_supported(settings)) {
+		return -1;
+	}
+	const auto conf{ lvds_config(readout_config(m_settings.combine, m_settings.combine_stop3), settings) };
+	auto calibration{ Calibration::from_config(conf) };
+	if (!m_settings.calibration_file.empty() && !calibration.load(m_settings.calibration_file)) {
+		return -1;
+	}
+	timing = Timing{ calibration };
+	// the ref_index of the lvds results is shorter than the 24 bits read over spi
+	unwrapper = RefIndexUnwrapper{ 1e12 / static_cast<double>(calibration.refclk_period_ps), settings.ref_index_bits };
+
+	if (m_settings.lvds_setup) {
+		gpx2 = std::make_unique<SPI::GPX2_TDC::GPX2>();
+		gpx2->init();
+		if (!set_spi_speed(conf.str(), false)) {
+			return -1;
+		}
+		if (!gpx2->write_config(conf) || gpx2->read_config() != conf.str()) {
+			std::cerr << "failed to write the lvds config!" << std::endl;
+			return -1;
+		}
+		chip_registers = conf.str();
+		watchdog.expect(chip_registers);
+	}
+	if (!lvds->open()) {
+		return -1;
+	}
+	if (gpx2) {
+		gpx2->init_reset();
+	}
+	return 0;
+}
+
+auto Readout::read_lvds()->int {
+	// the chip sends every result as soon as it is measured, a drain is what one read of the stream returns
+	const auto drain_start{ std::chrono::steady_clock::now() };
+	lvds_measurements.clear();
+	if (!lvds->read(lvds_measurements, lvds_timeout)) {
+		std::cerr << "end of the lvds stream" << std::endl;
+		return 1;
+	}
+	if (lvds_measurements.empty()) {
+		return 0;
+	}
+	drain_hits.clear();
+	for (const auto& meas : lvds_measurements) {
+		drain_hits.push_back(to_hit(meas, unwrapper.extend(meas.ref_index, meas.ts)));
+	}
+	enqueue(drain_hits, drain_start);
+	auto& counters{ monitor.counters() };
+	counters.drains.fetch_add(1U, std::memory_order_relaxed);
+	counters.busy_ns.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - drain_start).count()), std::memory_order_relaxed);
 	return 0;
 }
 
-void Readout::process_queue(bool ignore_max_queue) {
-	// checks ref_diff between ordered tdc_stop[0] and tdc_stop[1] channels.
-	// Compares a few values from the queues, removes not matching timestamps and prints matching ones
+void Readout::enqueue(std::vector<Hit>& hits, std::chrono::steady_clock::time_point drain_start) {
+	// common to all hit sources: monitoring, calibration and handing the hits to the processing
+	if (stop_mask != RuntimeConfig::all_stops) {
+		// results of disabled channels which were measured before the chip got the new enables
+		hits.erase(std::remove_if(hits.begin(), hits.end(), [this](const Hit& hit) { return (stop_mask & (1U << hit.channel)) == 0; }), hits.end());
+	}
+	for (const auto& hit : hits) {
+		monitor.count(hit);
+	}
+	timing.apply(hits);
+	if (gate_callback) {
+		gate_callback->wait(std::chrono::milliseconds{ 0 }, gate_edges);
+		gate.add_edges(gate_edges);
+	}
+	gate.apply(hits, drain_start);
+	if (hits.empty()) {
+		return;
+	}
+	const auto batch_size{ batching.batch_size() };
+	const auto overflows{ tdc_stop.counters().overflows.load(std::memory_order_relaxed) };
+	const auto queued{ tdc_stop.push(hits, m_run) };
+	if (tdc_stop.counters().overflows.load(std::memory_order_relaxed) != overflows) {
+		monitor.counters().queue_saturated.fetch_add(1U, std::memory_order_relaxed);
+	}
+	// wake up the processing once when the batch is complete
+	const bool full{ queued >= batch_size && queued < batch_size + hits.size() };
+	if (full) {
+		Reactor::notify(queue_full_event);
+	}
+}
 
-	std::mutex mutex;
-	std::unique_lock<std::mutex> lock {mutex};
-	if (queue_condition.wait_for(lock,std::chrono::seconds(1))==std::cv_status::timeout || (tdc_stop[0].size() < max_queue_size && tdc_stop[1].size() < max_queue_size && !ignore_max_queue)) {
+void Readout::process_queue(bool flush) {
+	// hands the collected hits of all channels to the coincidence engine and prints the found events.
+	// the engine keeps back the most recent hits, since hits of other channels may still be in the fifo.
+	const auto start{ std::chrono::steady_clock::now() };
+	std::chrono::steady_clock::time_point since{};
+	batch.clear();
+	const auto taken{ tdc_stop.pop_all(batch, since) };
+	if (runtime.version() != processing_version) {
+		// the version first, so the snapshot is at least as new as it
+		processing_version = runtime.version();
+		processing_config = runtime.load();
+		for (std::size_t g{ 0 }; g < processing_config->window_ps.size(); g++) {
+			coincidence.set_window(g, processing_config->window_ps[g]);
+		}
+	}
+	if (code_density) {
+		code_density->add(batch);
 		return;
 	}
-	std::array<std::vector<SPI::GPX2_TDC::Meas>,2> data{};
-	for (std::size_t i{0}; i<2; i++){
-		while(tdc_stop[i].size()>min_queue_size || (ignore_max_queue && !tdc_stop[i].empty())){
-			data[i].emplace_back(tdc_stop[i].front());
-			tdc_stop[i].pop();
-		}
-	}
-	// at this point one queue is full and we can check the content for 
-	std::sort(data[0].begin(), data[0].end());
-	std::unique(data[0].begin(), data[0].end());
-	std::sort(data[1].begin(), data[1].end());
-	std::unique(data[1].begin(), data[1].end());
-	
-	auto reset_ref = [&](){return static_cast<int32_t>(data[1].front().ref_index) - static_cast<int32_t>(data[0].front().ref_index);};
-	while (!data[0].empty() && !data[1].empty()) {
-		auto ref_diff = reset_ref();
-		while (ref_diff > 0) {
-			//std::cout << "ref_diff " << ref_diff << std::endl;
-			data[0].erase(data[0].begin());
-			//evt_count += 1U;
-			if (data[0].empty()) {
-				return;
+	batch_events.clear();
+	// the combiner writes every pair at once, only the coincidence search keeps hits back
+	const std::size_t held{ combiner ? 0 : coincidence.pending() };
+	if (combiner) {
+		// the chip pairs the edges itself, the coincidence search is not needed
+		combiner->process(batch, batch_events, flush);
+	} else {
+		// at low rates no later hit may come to release the kept back ones. a flush period without new
+		// hits means the fifos hold none of their windows anymore, so they are closed on the wall clock
+		const bool idle{ taken == 0 && held > 0 };
+		coincidence.process(batch, batch_events, flush || idle);
+	}
+	evt_count += batch_events.size();
+	for (auto& sink : sinks) {
+		if (sink.get() == text && !processing_config->text_output) {
+			continue;
+		}
+		sink->write(batch, batch_events);
+		if (flush) {
+			sink->flush();
+		}
+	}
+	if (taken > 0 || held > 0) {
+		// the oldest hit whose events could be written now, the kept back ones are older than the batch
+		const auto oldest{ held > 0 ? held_since : since };
+		const std::size_t still_held{ combiner ? 0 : coincidence.pending() };
+		// hits are released in time order, if no more are kept back than were taken all older ones are gone
+		if (taken > 0 && still_held <= taken) {
+			held_since = since;
+		}
+		const auto end{ std::chrono::steady_clock::now() };
+		if (batching.update(taken, end - oldest, end - start) && flush_timer >= 0) {
+			[[maybe_unused]] const auto rearmed{ Reactor::set_timer(flush_timer, batching.period()) };
+		}
+	}
+}
+
+auto Readout::control_command(const std::string& command)->std::string {
+	std::istringstream in{ command };
+	std::string name{};
+	std::vector<std::string> args{};
+	in >> name;
+	for (std::string arg{}; in >> arg;) {
+		args.push_back(arg);
+	}
+	RuntimeConfig config{ *runtime.load() };
+	if (name == "show" && args.empty()) {
+		return describe(config);
+	}
+	if (name == "window" && (args.size() == 1 || args.size() == 2)) {
+		if (combiner) {
+			return "error: the windows are fixed in combine mode";
+		}
+		std::int64_t group{ -1 };
+		std::int64_t window_ps{ 0 };
+		if (!parse_integer(args.back(), window_ps) || window_ps <= 0 || window_ps >= coincidence.max_window()) {
+			return "error: the window has to be between 1 and " + std::to_string(coincidence.max_window() - 1) + " ps";
+		}
+		if (args.size() == 2 && (!parse_integer(args.front(), group) || group < 0 || static_cast<std::size_t>(group) >= config.window_ps.size())) {
+			return "error: no group " + args.front();
+		}
+		for (std::size_t g{ 0 }; g < config.window_ps.size(); g++) {
+			if (group < 0 || static_cast<std::size_t>(group) == g) {
+				config.window_ps[g] = window_ps;
 			}
-			ref_diff = reset_ref();
-		}
-		while (ref_diff < 0) {
-			//std::cout << "ref_diff " << ref_diff << std::endl;
-			data[1].erase(data[1].begin());
-			//evt_count += 1U;
-			if (data[1].empty()) {
-				return;
+		}
+	} else if (name == "stops" && args.size() == 1) {
+		if (combiner) {
+			return "error: the stop channels are fixed in combine mode";
+		}
+		std::uint8_t mask{ 0 };
+		std::istringstream list{ args.front() };
+		for (std::string stop{}; std::getline(list, stop, ',');) {
+			std::int64_t channel{ 0 };
+			if (!parse_integer(stop, channel) || channel < 1 || channel > static_cast<std::int64_t>(stop_channels)) {
+				return "error: no stop channel " + stop;
 			}
-			ref_diff = reset_ref();
-		}
-		if (ref_diff == 0) {
-			auto diff = SPI::GPX2_TDC::diff(data[0].front(), data[1].front());
-			if (fabs(diff) < m_max_interval) {
-				evt_count += 1;
-				std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(data[0].front().ts.time_since_epoch()).count();
-				std::cout << " ";
-				std::cout << diff;
-				//std::cout << " " << q0.front().ref_index << " " << q0.front().stop_result;
-				//std::cout << " " << q1.front().ref_index << " " << q1.front().stop_result;
-				std::cout << "\n";
+			mask |= static_cast<std::uint8_t>(1U << (channel - 1));
+		}
+		if (mask == 0) {
+			return "error: no stop channel given";
+		}
+		config.stop_mask = mask;
+	} else if (name == "output" && args.size() == 1 && (args.front() == "text" || args.front() == "none")) {
+		config.text_output = args.front() == "text";
+	} else {
+		return "error: commands are show, window [group] ps, stops 1,2,3,4 and output text|none";
+	}
+	std::cerr << "control: " << describe(config) << std::endl;
+	runtime.publish(std::move(config));
+	return "ok";
+}
+
+void Readout::print_stats() {
+	const auto now{ std::chrono::high_resolution_clock::now() };
+	const std::uint64_t count{ evt_count };
+	const auto seconds{ std::chrono::duration<double>(now - last_stats_time).count() };
+	std::cerr << count << " events, current rate " << static_cast<double>(count - last_stats_count) / seconds << "/s" << std::endl;
+	last_stats_time = now;
+	last_stats_count = count;
+	std::cerr << monitor.last() << std::endl;
+	std::cerr << wait_metrics << std::endl;
+	std::cerr << batching.stats() << std::endl;
+	const auto& queue{ tdc_stop.counters() };
+	std::cerr << "hit queue " << tdc_stop.size() << "/" << tdc_stop.capacity() << ", overflows " << queue.overflows;
+	std::cerr << ", dropped oldest " << queue.dropped_oldest << " newest " << queue.dropped_newest << ", blocked " << queue.blocked_ns / 1000000U << " ms" << std::endl;
+	if (!m_settings.synthetic && (!lvds || m_settings.lvds_setup)) {
+		std::cerr << watchdog.counters() << std::endl;
+	}
+	if (lvds) {
+		std::cerr << lvds->counters() << std::endl;
+	}
+	if (gate.enabled()) {
+		std::cerr << gate.counters() << std::endl;
+	}
+	print_accidentals();
+	if (combiner) {
+		std::cerr << "combined channels: " << combiner->counters().pairs << " pairs, " << combiner->counters().unpaired << " unpaired results discarded" << std::endl;
+	}
+	if (net != nullptr) {
+		const auto served{ net->counters() };
+		std::cerr << "served to " << served.clients << " subscribers: " << served.frames << " frames, " << served.bytes / 1024U << " KiB, ";
+		std::cerr << served.dropped_frames << " frames dropped, " << served.disconnects << " slow subscribers disconnected" << std::endl;
+	}
+}
+
+void Readout::print_accidentals() {
+	const auto accidentals{ coincidence.accidentals() };
+	if (accidentals.empty() || combiner) {
+		return;
+	}
+	// the accidentals of a group are the mean over its delayed windows
+	const auto seconds{ std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count() };
+	const auto& counts{ coincidence.counts() };
+	for (std::size_t g{ 0 }; g < counts.size(); g++) {
+		std::uint64_t sum{ 0 };
+		std::size_t windows{ 0 };
+		for (const auto& delayed : accidentals) {
+			if (delayed.group == g) {
+				sum += delayed.count;
+				windows++;
 			}
-			data[0].erase(data[0].begin());
-			data[1].erase(data[1].begin());
 		}
+		if (windows == 0) {
+			continue;
+		}
+		const auto accidental{ static_cast<double>(sum) / static_cast<double>(windows) };
+		std::cerr << "group " << g << ": " << counts[g] << " coincidences (" << static_cast<double>(counts[g]) / seconds << "/s), ";
+		std::cerr << accidental << " accidentals (" << accidental / seconds << "/s) from " << windows << " delayed windows" << std::endl;
+	}
+}
+
+void Readout::sample_monitor() {
+	const auto previous{ monitor.last() };
+	const auto sample{ monitor.sample() };
+	if (sample.ref_gaps > previous.ref_gaps || sample.queue_saturated > previous.queue_saturated) {
+		std::cerr << "possible data loss: " << sample << std::endl;
 	}
 }
+
+void Readout::print_statistics() {
+	std::cerr << "statistics of the last " << m_settings.statistics_interval.count() << " s:\n";
+	statistics->snapshot().print(std::cerr);
+	std::cerr.flush();
+}
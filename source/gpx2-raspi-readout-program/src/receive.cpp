@@ -0,0 +1,86 @@
+#include "net_stream.h"
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+volatile std::sig_atomic_t interrupted{ 0 };
+}
+
+void usage(const char* name) {
+	std::cerr << "usage: " << name << " host port [-n frames] [-q]\n";
+	std::cerr << "subscribes to the hits and coincidences a readout serves with --serve port\n";
+	std::cerr << "  -n              stop after this many frames\n";
+	std::cerr << "  -q              no text output of the coincidences on stdout" << std::endl;
+}
+
+auto main(int argc, char* argv[])->int {
+	std::string host{};
+	std::string port{};
+	std::uint64_t max_frames{ 0 };
+	bool text_output{ true };
+	for (int i{ 1 }; i < argc; i++) {
+		const std::string arg{ argv[i] };
+		if (arg == "-n" && i + 1 < argc) {
+			max_frames = std::strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "-q") {
+			text_output = false;
+		} else if (host.empty() && !arg.empty() && arg[0] != '-') {
+			host = arg;
+		} else if (port.empty() && !arg.empty() && arg[0] != '-') {
+			port = arg;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (host.empty() || port.empty()) {
+		usage(argv[0]);
+		return 1;
+	}
+	// no SA_RESTART, so a signal ends the blocking receive and the summary is still printed
+	struct sigaction action{};
+	action.sa_handler = [](int) { interrupted = 1; };
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+
+	NetReceiver receiver{};
+	if (!receiver.connect(host, port)) {
+		return 1;
+	}
+	const auto start{ std::chrono::steady_clock::now() };
+	std::vector<NetHitRecord> hits{};
+	std::vector<NetCoincidenceRecord> events{};
+	std::uint64_t total_hits{ 0 };
+	std::uint64_t total_events{ 0 };
+	while (interrupted == 0 && (max_frames == 0 || receiver.frames() < max_frames)) {
+		hits.clear();
+		events.clear();
+		if (!receiver.next(hits, events)) {
+			break;
+		}
+		total_hits += hits.size();
+		total_events += events.size();
+		if (!text_output) {
+			continue;
+		}
+		// same format as the text output of the readout
+		for (const auto& event : events) {
+			std::cout << event.time_ps << " " << static_cast<unsigned>(event.group);
+			for (unsigned ch{ 0 }; ch < 4; ch++) {
+				if ((event.channel_mask & (1U << ch)) != 0) {
+					std::cout << " " << ch + 1 << ":" << event.offset_ps[ch];
+				}
+			}
+			std::cout << "\n";
+		}
+	}
+	std::cout.flush();
+	const double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+	std::cerr << receiver.frames() << " frames, " << total_hits << " hits, " << total_events << " coincidences in " << seconds << " s, ";
+	std::cerr << receiver.lost_frames() << " frames lost" << std::endl;
+	return 0;
+}
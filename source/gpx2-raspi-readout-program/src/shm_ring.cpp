@@ -0,0 +1,170 @@
+#include "shm_ring.h"
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+auto shm_path(const std::string& name)->std::string {
+	return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+}
+
+ShmWriter::~ShmWriter() {
+	if (m_header != nullptr) {
+		m_header->closed.store(1U, std::memory_order_release);
+	}
+	if (m_memory != nullptr) {
+		munmap(m_memory, m_size);
+		shm_unlink(m_name.c_str());
+	}
+}
+
+auto ShmWriter::open(const std::string& name, std::size_t capacity)->bool {
+	std::size_t slots{ 1 };
+	while (slots < capacity) {
+		slots <<= 1U;
+	}
+	m_name = shm_path(name);
+	shm_unlink(m_name.c_str());
+	const int fd{ shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644) };
+	if (fd < 0) {
+		std::cerr << "could not create shared memory " << m_name << std::endl;
+		return false;
+	}
+	m_size = sizeof(ShmHeader) + slots * sizeof(ShmSlot);
+	if (ftruncate(fd, static_cast<off_t>(m_size)) < 0) {
+		std::cerr << "could not resize shared memory " << m_name << std::endl;
+		close(fd);
+		shm_unlink(m_name.c_str());
+		return false;
+	}
+	m_memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (m_memory == MAP_FAILED) {
+		std::cerr << "could not map shared memory " << m_name << std::endl;
+		m_memory = nullptr;
+		shm_unlink(m_name.c_str());
+		return false;
+	}
+	// the new object is zero filled, which is a valid state for the atomics
+	m_header = static_cast<ShmHeader*>(m_memory);
+	m_slots = reinterpret_cast<ShmSlot*>(static_cast<char*>(m_memory) + sizeof(ShmHeader));
+	m_header->capacity = slots;
+	m_header->slot_size = static_cast<std::uint16_t>(sizeof(ShmSlot));
+	m_header->version = shm_version;
+	m_header->write_seq.store(0, std::memory_order_relaxed);
+	m_header->closed.store(0, std::memory_order_relaxed);
+	m_header->magic.store(shm_magic, std::memory_order_release);
+	return true;
+}
+
+void ShmWriter::write(const ShmRecord* records, std::size_t n) {
+	if (m_header == nullptr || n == 0) {
+		return;
+	}
+	const std::uint64_t mask{ m_header->capacity - 1U };
+	for (std::size_t i{ 0 }; i < n; i++) {
+		m_seq++;
+		auto& slot{ m_slots[(m_seq - 1U) & mask] };
+		slot.seq.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(static_cast<void*>(&slot.record), &records[i], sizeof(ShmRecord));
+		slot.seq.store(m_seq, std::memory_order_release);
+	}
+	m_header->write_seq.store(m_seq, std::memory_order_release);
+}
+
+auto ShmWriter::written() const->std::uint64_t {
+	return m_seq;
+}
+
+ShmReader::~ShmReader() {
+	if (m_memory != nullptr) {
+		munmap(m_memory, m_size);
+	}
+}
+
+auto ShmReader::open(const std::string& name, bool from_oldest)->bool {
+	const std::string path{ shm_path(name) };
+	const int fd{ shm_open(path.c_str(), O_RDONLY, 0) };
+	if (fd < 0) {
+		std::cerr << "could not open shared memory " << path << std::endl;
+		return false;
+	}
+	struct stat st{};
+	if (fstat(fd, &st) < 0 || static_cast<std::size_t>(st.st_size) < sizeof(ShmHeader)) {
+		std::cerr << "shared memory " << path << " is not a hit ring" << std::endl;
+		close(fd);
+		return false;
+	}
+	m_size = static_cast<std::size_t>(st.st_size);
+	m_memory = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (m_memory == MAP_FAILED) {
+		std::cerr << "could not map shared memory " << path << std::endl;
+		m_memory = nullptr;
+		return false;
+	}
+	m_header = static_cast<const ShmHeader*>(m_memory);
+	if (m_header->magic.load(std::memory_order_acquire) != shm_magic || m_header->version != shm_version || m_header->slot_size != sizeof(ShmSlot)
+		|| m_size < sizeof(ShmHeader) + m_header->capacity * sizeof(ShmSlot)) {
+		std::cerr << "shared memory " << path << " has an incompatible layout" << std::endl;
+		munmap(m_memory, m_size);
+		m_memory = nullptr;
+		m_header = nullptr;
+		return false;
+	}
+	m_slots = reinterpret_cast<const ShmSlot*>(static_cast<const char*>(m_memory) + sizeof(ShmHeader));
+	const std::uint64_t written{ m_header->write_seq.load(std::memory_order_acquire) };
+	if (!from_oldest) {
+		m_next = written + 1U;
+	} else if (written > m_header->capacity) {
+		m_next = written - m_header->capacity + 1U;
+	}
+	return true;
+}
+
+auto ShmReader::read(std::vector<ShmRecord>& out, std::size_t max)->std::size_t {
+	if (m_header == nullptr) {
+		return 0;
+	}
+	const std::uint64_t capacity{ m_header->capacity };
+	const std::uint64_t written{ m_header->write_seq.load(std::memory_order_acquire) };
+	if (written >= m_next + capacity) {
+		// overtaken by the writer
+		m_lost += written - capacity + 1U - m_next;
+		m_next = written - capacity + 1U;
+	}
+	std::size_t n{ 0 };
+	ShmRecord record{};
+	while (n < max && m_next <= written) {
+		const auto& slot{ m_slots[(m_next - 1U) & (capacity - 1U)] };
+		const auto before{ slot.seq.load(std::memory_order_acquire) };
+		std::memcpy(static_cast<void*>(&record), &slot.record, sizeof(ShmRecord));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const auto after{ slot.seq.load(std::memory_order_relaxed) };
+		if (before != m_next || after != m_next) {
+			// the slot was overwritten while we copied it, continue with the oldest record still available
+			const std::uint64_t now{ m_header->write_seq.load(std::memory_order_acquire) };
+			const std::uint64_t oldest{ now >= capacity ? now - capacity + 2U : 1U };
+			m_lost += (oldest > m_next) ? oldest - m_next : 1U;
+			m_next = (oldest > m_next) ? oldest : m_next + 1U;
+			continue;
+		}
+		out.push_back(record);
+		m_next++;
+		n++;
+	}
+	return n;
+}
+
+auto ShmReader::lost() const->std::uint64_t {
+	return m_lost;
+}
+
+auto ShmReader::writer_closed() const->bool {
+	return m_header != nullptr && m_header->closed.load(std::memory_order_acquire) != 0;
+}
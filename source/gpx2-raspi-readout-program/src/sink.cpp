@@ -0,0 +1,132 @@
+#include "sink.h"
+#include "codec.h"
+#include <cstdio>
+#include <iostream>
+#include <ostream>
+
+TextSink::TextSink(std::ostream& out)
+	: m_out{ out }
+{
+}
+
+void TextSink::write(const std::vector<Hit>&, const std::vector<CoincidenceEvent>& events) {
+	for (const auto& event : events) {
+		m_out << event.time_ps << " " << static_cast<unsigned>(event.group);
+		for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+			if ((event.channel_mask & (1U << ch)) != 0) {
+				m_out << " " << ch + 1 << ":" << event.offset_ps[ch];
+			}
+		}
+		m_out << "\n";
+	}
+}
+
+void TextSink::flush() {
+	m_out.flush();
+}
+
+auto ShmSink::open(const std::string& name, std::size_t capacity)->bool {
+	return m_writer.open(name, capacity);
+}
+
+void ShmSink::write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) {
+	m_records.clear();
+	for (const auto& hit : hits) {
+		ShmRecord record{};
+		record.type = ShmRecordType::Hit;
+		record.hit.time_ps = hit.time_ps;
+		record.hit.ref_index = hit.ref_index;
+		record.hit.stop_result = hit.stop_result;
+		record.hit.channel = hit.channel;
+		m_records.push_back(record);
+	}
+	for (const auto& event : events) {
+		ShmRecord record{};
+		record.type = ShmRecordType::Coincidence;
+		record.coincidence = ShmCoincidenceRecord{};
+		record.coincidence.time_ps = event.time_ps;
+		for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+			record.coincidence.offset_ps[ch] = event.offset_ps[ch];
+		}
+		record.coincidence.group = event.group;
+		record.coincidence.channel_mask = event.channel_mask;
+		m_records.push_back(record);
+	}
+	m_writer.write(m_records.data(), m_records.size());
+}
+
+auto FileSink::open(const std::string& file)->bool {
+	m_out.open(file, std::ios::binary | std::ios::app);
+	if (!m_out) {
+		std::cerr << "could not open " << file << " for recording" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void FileSink::write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) {
+	if (hits.empty() && events.empty()) {
+		return;
+	}
+	m_block.clear();
+	encode_block(hits, events, m_block);
+	m_out.write(reinterpret_cast<const char*>(m_block.data()), static_cast<std::streamsize>(m_block.size()));
+}
+
+void FileSink::flush() {
+	m_out.flush();
+}
+
+void StatisticsSink::write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) {
+	m_current.add(hits, events);
+}
+
+auto StatisticsSink::snapshot()->PairStatistics {
+	const auto result{ m_current };
+	m_total.merge(m_current);
+	m_current.clear();
+	return result;
+}
+
+auto StatisticsSink::total() const->PairStatistics {
+	auto result{ m_total };
+	result.merge(m_current);
+	return result;
+}
+
+CorrelationSink::CorrelationSink(const std::vector<Correlator::Settings>& pairs) {
+	for (const auto& pair : pairs) {
+		m_correlators.emplace_back(pair);
+	}
+}
+
+void CorrelationSink::write(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>&) {
+	for (auto& correlator : m_correlators) {
+		correlator.add(hits);
+	}
+}
+
+void CorrelationSink::flush() {
+	for (auto& correlator : m_correlators) {
+		correlator.flush();
+	}
+}
+
+auto CorrelationSink::snapshot(const std::string& file) const->bool {
+	const std::string temporary{ file + ".tmp" };
+	{
+		std::ofstream out{ temporary, std::ios::trunc };
+		for (const auto& correlator : m_correlators) {
+			correlator.save(out);
+		}
+		if (!out) {
+			std::cerr << "could not write the g2 curves to " << temporary << std::endl;
+			return false;
+		}
+	}
+	if (std::rename(temporary.c_str(), file.c_str()) != 0) {
+		std::cerr << "could not replace " << file << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,141 @@
+#include "spi_speed.h"
+#include "logger.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+SpiSpeed::SpiSpeed(Settings settings)
+	: m_settings{ std::move(settings) }
+	, m_board{ board_id() }
+{
+	if (m_settings.ladder.empty()) {
+		m_settings.ladder.push_back(61'035);
+	}
+}
+
+auto SpiSpeed::select(SPI::GPX2_TDC::GPX2& gpx2, const std::string& registers, bool measuring)->bool {
+	m_next_check = std::chrono::steady_clock::now() + m_settings.check_interval;
+	const auto stored{ load() };
+	if (stored > 0) {
+		gpx2.set_speed(stored);
+		if (gpx2.transfer_test(registers, m_settings.check_transfers, !measuring) == 0) {
+			std::cerr << "spi speed " << stored << " Hz of board " << m_board << std::endl;
+			return true;
+		}
+		std::cerr << "stored spi speed " << stored << " Hz of board " << m_board << " failed the test" << std::endl;
+		gpx2.set_speed(m_settings.ladder.front());
+	}
+	if (measuring) {
+		// a corrupted opcode at too high speeds could be taken as a reset, so a running chip is not calibrated
+		std::cerr << "the gpx2 is measuring, spi speed calibration skipped" << std::endl;
+		return true;
+	}
+	return calibrate(gpx2, registers, measuring);
+}
+
+auto SpiSpeed::calibrate(SPI::GPX2_TDC::GPX2& gpx2, const std::string& registers, bool measuring)->bool {
+	const double bits{ static_cast<double>(m_settings.transfers) * static_cast<double>(registers.size()) * 8. };
+	std::size_t fastest{ m_settings.ladder.size() };
+	for (std::size_t i{ 0 }; i < m_settings.ladder.size(); i++) {
+		gpx2.set_speed(m_settings.ladder[i]);
+		const auto errors{ gpx2.transfer_test(registers, m_settings.transfers, !measuring) };
+		std::cerr << "spi speed " << m_settings.ladder[i] << " Hz: bit error rate " << static_cast<double>(errors) / bits << std::endl;
+		if (errors > 0) {
+			break;
+		}
+		fastest = i;
+	}
+	if (fastest == m_settings.ladder.size()) {
+		std::cerr << "the spi link to the gpx2 does not work at any speed" << std::endl;
+		gpx2.set_speed(m_settings.ladder.front());
+		return false;
+	}
+	const std::size_t selected{ fastest >= m_settings.margin_steps ? fastest - m_settings.margin_steps : 0U };
+	gpx2.set_speed(m_settings.ladder[selected]);
+	std::cerr << "selected spi speed " << m_settings.ladder[selected] << " Hz for board " << m_board << std::endl;
+	store(m_settings.ladder[selected]);
+	return true;
+}
+
+auto SpiSpeed::check(SPI::GPX2_TDC::GPX2& gpx2, const std::string& registers)->bool {
+	m_next_check = std::chrono::steady_clock::now() + m_settings.check_interval;
+	const auto errors{ gpx2.transfer_test(registers, m_settings.check_transfers, false) };
+	if (errors == 0) {
+		return true;
+	}
+	std::size_t current{ 0 };
+	while (current + 1 < m_settings.ladder.size() && m_settings.ladder[current + 1] <= gpx2.speed()) {
+		current++;
+	}
+	if (current == 0) {
+		static SPI::LogSite failed{ "{} bit errors on the spi link at the slowest speed {} Hz" };
+		SPI::log(failed, errors, gpx2.speed());
+		return false;
+	}
+	static SPI::LogSite lowered{ "{} bit errors on the spi link at {} Hz, lowered to {} Hz" };
+	SPI::log(lowered, errors, gpx2.speed(), m_settings.ladder[current - 1]);
+	gpx2.set_speed(m_settings.ladder[current - 1]);
+	store(m_settings.ladder[current - 1]);
+	return true;
+}
+
+auto SpiSpeed::check_due(std::chrono::steady_clock::time_point now) const->bool {
+	return now >= m_next_check;
+}
+
+auto SpiSpeed::board_id()->std::string {
+	for (const char* file : { "/proc/device-tree/serial-number", "/etc/machine-id" }) {
+		std::ifstream in{ file };
+		std::string id{};
+		std::getline(in, id, '\0');
+		while (!id.empty() && (id.back() == '\n' || id.back() == ' ')) {
+			id.pop_back();
+		}
+		if (!id.empty()) {
+			return id;
+		}
+	}
+	return "unknown";
+}
+
+auto SpiSpeed::load()->std::uint32_t {
+	if (m_settings.file.empty()) {
+		return 0;
+	}
+	std::ifstream in{ m_settings.file };
+	std::string line{};
+	while (std::getline(in, line)) {
+		std::istringstream entry{ line };
+		std::string board{};
+		std::uint32_t speed{ 0 };
+		if (entry >> board >> speed && board == m_board) {
+			return speed;
+		}
+	}
+	return 0;
+}
+
+void SpiSpeed::store(std::uint32_t speed) {
+	if (m_settings.file.empty()) {
+		return;
+	}
+	// the entries of other boards are kept
+	std::ostringstream content{};
+	{
+		std::ifstream in{ m_settings.file };
+		std::string line{};
+		while (std::getline(in, line)) {
+			std::istringstream entry{ line };
+			std::string board{};
+			if (entry >> board && board != m_board) {
+				content << line << "\n";
+			}
+		}
+	}
+	content << m_board << " " << speed << "\n";
+	std::ofstream out{ m_settings.file, std::ios::trunc };
+	out << content.str();
+	if (!out) {
+		std::cerr << "could not store the spi speed in " << m_settings.file << std::endl;
+	}
+}
@@ -0,0 +1,89 @@
+#include "statistics.h"
+#include <cmath>
+
+void RunningStats::merge(const RunningStats& other) {
+	if (other.count == 0) {
+		return;
+	}
+	if (count == 0) {
+		*this = other;
+		return;
+	}
+	const double n_a{ static_cast<double>(count) };
+	const double n_b{ static_cast<double>(other.count) };
+	const double n{ n_a + n_b };
+	const double delta{ other.mean - mean };
+	mean += delta * n_b / n;
+	m2 += other.m2 + delta * delta * n_a * n_b / n;
+	count += other.count;
+	min = other.min < min ? other.min : min;
+	max = other.max > max ? other.max : max;
+}
+
+auto RunningStats::variance() const->double {
+	return count > 1 ? m2 / static_cast<double>(count - 1) : 0.;
+}
+
+auto RunningStats::stddev() const->double {
+	return std::sqrt(variance());
+}
+
+auto operator<<(std::ostream& out, const RunningStats& stats)->std::ostream& {
+	out << "n " << stats.count << " mean " << stats.mean << " sigma " << stats.stddev() << " min " << stats.min << " max " << stats.max;
+	return out;
+}
+
+void PairStatistics::add(const std::vector<Hit>& hits, const std::vector<CoincidenceEvent>& events) {
+	for (const auto& hit : hits) {
+		m_stop_results[hit.channel].add(static_cast<double>(hit.stop_result));
+	}
+	for (const auto& event : events) {
+		for (std::size_t first{ 0 }; first < stop_channels; first++) {
+			if ((event.channel_mask & (1U << first)) == 0) {
+				continue;
+			}
+			for (std::size_t second{ first + 1 }; second < stop_channels; second++) {
+				if ((event.channel_mask & (1U << second)) != 0) {
+					m_intervals[pair_index(first, second)].add(static_cast<double>(event.offset_ps[second] - event.offset_ps[first]));
+				}
+			}
+		}
+	}
+}
+
+void PairStatistics::merge(const PairStatistics& other) {
+	for (std::size_t i{ 0 }; i < pairs; i++) {
+		m_intervals[i].merge(other.m_intervals[i]);
+	}
+	for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+		m_stop_results[ch].merge(other.m_stop_results[ch]);
+	}
+}
+
+void PairStatistics::clear() {
+	*this = PairStatistics{};
+}
+
+auto PairStatistics::interval(std::size_t first, std::size_t second) const->const RunningStats& {
+	return m_intervals[pair_index(first, second)];
+}
+
+auto PairStatistics::stop_result(std::size_t channel) const->const RunningStats& {
+	return m_stop_results[channel];
+}
+
+void PairStatistics::print(std::ostream& out) const {
+	for (std::size_t first{ 0 }; first < stop_channels; first++) {
+		for (std::size_t second{ first + 1 }; second < stop_channels; second++) {
+			const auto& stats{ interval(first, second) };
+			if (stats.count > 0) {
+				out << "interval " << first + 1 << "-" << second + 1 << " ps: " << stats << "\n";
+			}
+		}
+	}
+	for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+		if (m_stop_results[ch].count > 0) {
+			out << "stop_result " << ch + 1 << ": " << m_stop_results[ch] << "\n";
+		}
+	}
+}
@@ -0,0 +1,141 @@
+#include "timing.h"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+auto Calibration::from_config(SPI::GPX2_TDC::Config config)->Calibration {
+	Calibration calibration{};
+	calibration.refclk_period_ps = std::llround(1e12 / config.refclk_freq);
+	calibration.refclk_divisions = config.refclk_divisions();
+	return calibration;
+}
+
+auto Calibration::load(const std::string& file)->bool {
+	std::ifstream in{ file };
+	if (!in) {
+		std::cerr << "could not open calibration file " << file << std::endl;
+		return false;
+	}
+	std::string line{};
+	while (std::getline(in, line)) {
+		std::istringstream entry{ line };
+		std::string key{};
+		if (!(entry >> key) || key[0] == '#') {
+			continue;
+		}
+		if (key == "refclk_period_ps") {
+			entry >> refclk_period_ps;
+		} else if (key == "refclk_divisions") {
+			entry >> refclk_divisions;
+		} else if (key == "offset_ps" || key == "stop_lut") {
+			unsigned channel{ stop_channels };
+			entry >> channel;
+			if (channel >= stop_channels) {
+				std::cerr << "invalid channel in calibration file: " << line << std::endl;
+				return false;
+			}
+			if (key == "offset_ps") {
+				entry >> offset_ps[channel];
+				continue;
+			}
+			std::size_t size{};
+			entry >> size;
+			stop_lut[channel].resize(size);
+			for (auto& value : stop_lut[channel]) {
+				entry >> value;
+			}
+		}
+		if (entry.fail()) {
+			std::cerr << "malformed line in calibration file: " << key << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+auto Calibration::save(const std::string& file) const->bool {
+	std::ofstream out{ file };
+	if (!out) {
+		std::cerr << "could not write calibration file " << file << std::endl;
+		return false;
+	}
+	out << "# gpx2 calibration table\n";
+	out << "refclk_period_ps " << refclk_period_ps << "\n";
+	out << "refclk_divisions " << refclk_divisions << "\n";
+	for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+		out << "offset_ps " << ch << " " << offset_ps[ch] << "\n";
+	}
+	for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+		if (stop_lut[ch].empty()) {
+			continue;
+		}
+		out << "stop_lut " << ch << " " << stop_lut[ch].size();
+		for (auto value : stop_lut[ch]) {
+			out << " " << value;
+		}
+		out << "\n";
+	}
+	return static_cast<bool>(out);
+}
+
+Timing::Timing(Calibration calibration)
+	: m_calibration{ std::move(calibration) }
+{
+	if (m_calibration.refclk_divisions != 0) {
+		m_lsb_q32 = (static_cast<std::uint64_t>(m_calibration.refclk_period_ps) << 32U) / m_calibration.refclk_divisions;
+	}
+}
+
+void Timing::apply(std::vector<Hit>& hits) const {
+	for (auto& hit : hits) {
+		hit.time_ps = time_ps(hit.ref_index, hit.stop_result, hit.channel);
+	}
+}
+
+auto Timing::calibration() const->const Calibration& {
+	return m_calibration;
+}
+
+CodeDensityCalibration::CodeDensityCalibration(std::uint32_t refclk_divisions)
+{
+	for (auto& histogram : m_histogram) {
+		histogram.resize(refclk_divisions);
+	}
+}
+
+void CodeDensityCalibration::add(const std::vector<Hit>& hits) {
+	for (const auto& hit : hits) {
+		auto& histogram{ m_histogram[hit.channel] };
+		if (hit.stop_result < histogram.size()) {
+			histogram[hit.stop_result]++;
+			m_entries[hit.channel]++;
+		}
+	}
+}
+
+auto CodeDensityCalibration::entries(std::uint8_t channel) const->std::uint64_t {
+	return m_entries[channel];
+}
+
+auto CodeDensityCalibration::apply_to(Calibration& calibration) const->unsigned {
+	unsigned updated{ 0 };
+	for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+		const auto& histogram{ m_histogram[ch] };
+		const std::uint64_t total{ m_entries[ch] };
+		if (histogram.empty() || total < histogram.size()) {
+			continue;
+		}
+		auto& lut{ calibration.stop_lut[ch] };
+		lut.resize(histogram.size());
+		// every code is placed at the center of its share of the reference period
+		std::uint64_t cumulative{ 0 };
+		for (std::size_t code{ 0 }; code < histogram.size(); code++) {
+			const std::uint64_t position{ 2U * cumulative + histogram[code] };
+			lut[code] = static_cast<std::int32_t>(position * static_cast<std::uint64_t>(calibration.refclk_period_ps) / (2U * total));
+			cumulative += histogram[code];
+		}
+		updated++;
+	}
+	return updated;
+}
@@ -0,0 +1,156 @@
+#include "wait_policy.h"
+#include <algorithm>
+#include <ctime>
+#include <thread>
+
+namespace {
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield");
+#else
+	std::this_thread::yield();
+#endif
+}
+
+auto to_ns(const timespec& ts)->std::int64_t {
+	return static_cast<std::int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+auto clock_ns(clockid_t clock)->std::int64_t {
+	timespec ts{};
+	clock_gettime(clock, &ts);
+	return to_ns(ts);
+}
+}
+
+InterruptWait::InterruptWait(Settings settings, gpio::callback& callback, unsigned pin, Metrics& metrics)
+	: m_settings{ settings }
+	, m_callback{ callback }
+	, m_pin{ pin }
+	, m_budget{ std::clamp(settings.spin_budget, settings.min_spin_budget, settings.max_spin_budget) }
+	, m_metrics{ metrics }
+{
+	m_metrics.spin_budget_ns = m_budget.count();
+}
+
+auto InterruptWait::wait(const std::atomic<bool>& run)->Wake {
+	m_metrics.waits.fetch_add(1U, std::memory_order_relaxed);
+	// edges of earlier bursts are of no interest anymore
+	drain_events();
+	m_events.clear();
+	const auto start{ std::chrono::steady_clock::now() };
+	if (asserted()) {
+		m_metrics.immediate.fetch_add(1U, std::memory_order_relaxed);
+		return Wake::Immediate;
+	}
+	if (m_settings.mode != Mode::Block) {
+		const bool bounded{ m_settings.mode == Mode::Hybrid };
+		auto now{ start };
+		while (run) {
+			cpu_relax();
+			const bool ready{ asserted() };
+			now = std::chrono::steady_clock::now();
+			if (ready) {
+				spent(m_metrics.spin_ns, now - start);
+				m_metrics.spin_wakeups.fetch_add(1U, std::memory_order_relaxed);
+				drain_events();
+				record_latency();
+				adapt(now - start);
+				return Wake::Spin;
+			}
+			if (bounded && now - start >= m_budget) {
+				break;
+			}
+		}
+		spent(m_metrics.spin_ns, now - start);
+	}
+	const auto block_start{ std::chrono::steady_clock::now() };
+	while (run) {
+		// the edge may have come before the wait, then it is already queued and wait returns at once
+		m_callback.wait(block_timeout, m_events);
+		if (asserted()) {
+			const auto now{ std::chrono::steady_clock::now() };
+			spent(m_metrics.block_ns, now - block_start);
+			m_metrics.block_wakeups.fetch_add(1U, std::memory_order_relaxed);
+			record_latency();
+			adapt(now - start);
+			return Wake::Block;
+		}
+	}
+	spent(m_metrics.block_ns, std::chrono::steady_clock::now() - block_start);
+	return Wake::Stopped;
+}
+
+auto InterruptWait::parse_mode(const std::string& name, Mode& mode)->bool {
+	if (name == "spin") {
+		mode = Mode::Spin;
+	} else if (name == "block") {
+		mode = Mode::Block;
+	} else if (name == "hybrid") {
+		mode = Mode::Hybrid;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+auto InterruptWait::asserted()->bool {
+	return m_callback.read(m_pin) == 0;
+}
+
+void InterruptWait::drain_events() {
+	m_callback.wait(std::chrono::milliseconds{ 0 }, m_events);
+}
+
+void InterruptWait::record_latency() {
+	auto edge{ std::find_if(m_events.rbegin(), m_events.rend(), [](const gpio::event& e) { return e.type == gpio::event::Falling; }) };
+	if (edge == m_events.rend()) {
+		return;
+	}
+	// depending on the kernel the line events are stamped with the monotonic or the realtime clock
+	const auto stamp{ to_ns(edge->ts) };
+	std::int64_t latency{ clock_ns(CLOCK_MONOTONIC) - stamp };
+	if (latency < 0 || latency > 1000000000LL) {
+		latency = clock_ns(CLOCK_REALTIME) - stamp;
+	}
+	if (latency < 0 || latency > 1000000000LL) {
+		return;
+	}
+	const auto value{ static_cast<std::uint64_t>(latency) };
+	m_metrics.latency_ns.fetch_add(value, std::memory_order_relaxed);
+	m_metrics.latency_count.fetch_add(1U, std::memory_order_relaxed);
+	if (value > m_metrics.max_latency_ns.load(std::memory_order_relaxed)) {
+		m_metrics.max_latency_ns.store(value, std::memory_order_relaxed);
+	}
+}
+
+void InterruptWait::adapt(std::chrono::nanoseconds gap) {
+	if (!m_settings.adaptive || m_settings.mode != Mode::Hybrid) {
+		return;
+	}
+	const std::chrono::nanoseconds min{ m_settings.min_spin_budget };
+	const std::chrono::nanoseconds max{ m_settings.max_spin_budget };
+	// gaps up to the maximum budget should be caught spinning, longer ones would only waste cpu
+	const auto target{ gap <= max ? std::clamp(2 * gap, min, max) : min };
+	if (target > m_budget) {
+		m_budget = target;
+	} else {
+		m_budget -= (m_budget - target) / 8;
+	}
+	m_metrics.spin_budget_ns.store(m_budget.count(), std::memory_order_relaxed);
+}
+
+void InterruptWait::spent(std::atomic<std::uint64_t>& counter, std::chrono::steady_clock::duration duration) {
+	counter.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()), std::memory_order_relaxed);
+}
+
+auto operator<<(std::ostream& out, const InterruptWait::Metrics& metrics)->std::ostream& {
+	const auto latency_count{ metrics.latency_count.load() };
+	out << "waits " << metrics.waits << " (immediate " << metrics.immediate << ", spin " << metrics.spin_wakeups << ", block " << metrics.block_wakeups << ")";
+	out << ", spinning " << metrics.spin_ns / 1000000U << " ms, blocked " << metrics.block_ns / 1000000U << " ms";
+	out << ", wake latency mean " << (latency_count > 0 ? metrics.latency_ns / latency_count / 1000U : 0U) << " us max " << metrics.max_latency_ns / 1000U << " us";
+	out << ", spin budget " << metrics.spin_budget_ns / 1000 << " us";
+	return out;
+}
@@ -0,0 +1,53 @@
+#include "watchdog.h"
+#include "logger.h"
+#include <algorithm>
+
+RegisterWatchdog::RegisterWatchdog(Settings settings)
+	: m_settings{ settings }
+{
+	m_settings.registers_per_check = std::max(m_settings.registers_per_check, 1U);
+}
+
+void RegisterWatchdog::expect(const std::string& registers) {
+	m_registers = registers;
+	m_next = 0;
+	m_next_check = std::chrono::steady_clock::now() + m_settings.interval;
+}
+
+auto RegisterWatchdog::due(std::chrono::steady_clock::time_point now) const->bool {
+	return m_settings.interval.count() > 0 && !m_registers.empty() && now >= m_next_check;
+}
+
+auto RegisterWatchdog::check(SPI::GPX2_TDC::GPX2& gpx2)->bool {
+	m_next_check = std::chrono::steady_clock::now() + m_settings.interval;
+	bool ok{ true };
+	for (unsigned i{ 0 }; i < m_settings.registers_per_check; i++) {
+		const auto reg_addr{ static_cast<std::uint8_t>(m_next) };
+		const auto expected{ static_cast<std::uint8_t>(m_registers[m_next]) };
+		m_next = (m_next + 1) % m_registers.size();
+		const int result{ gpx2.repair_register(reg_addr, expected) };
+		m_counters.checked.fetch_add(1, std::memory_order_relaxed);
+		if (result > 0) {
+			m_counters.repaired.fetch_add(1, std::memory_order_relaxed);
+			static SPI::LogSite repaired{ "config register {} of the gpx2 was corrupted and has been repaired" };
+			SPI::log(repaired, reg_addr);
+		} else if (result < 0) {
+			m_counters.failed.fetch_add(1, std::memory_order_relaxed);
+			static SPI::LogSite failed{ "config register {} of the gpx2 could not be repaired" };
+			SPI::log(failed, reg_addr);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+auto RegisterWatchdog::counters() const->const Counters& {
+	return m_counters;
+}
+
+auto operator<<(std::ostream& out, const RegisterWatchdog::Counters& counters)->std::ostream& {
+	out << "config registers checked " << counters.checked.load(std::memory_order_relaxed);
+	out << ", repaired " << counters.repaired.load(std::memory_order_relaxed);
+	out << ", not repairable " << counters.failed.load(std::memory_order_relaxed);
+	return out;
+}
@@ -0,0 +1,102 @@
+// decodes a small captured lvds stream (single data rate, 16 bit ref_index, 20 bit stop result) with
+// LvdsSource, in reads of a few bytes so the results span several of them. the capture holds results
+// on all channels, overlapping in time, a frame cut off by the next one and a stop result beyond the
+// refclk divisions. a double data rate stream of test pattern words is checked in memory.
+#include "lvds.h"
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+namespace {
+int failures{ 0 };
+
+void check(bool condition, const std::string& what) {
+	if (!condition) {
+		std::cerr << "failed: " << what << std::endl;
+		failures++;
+	}
+}
+
+struct Expected {
+	unsigned channel{};
+	std::uint32_t ref_index{};
+	std::uint32_t stop_result{};
+};
+
+void capture(const std::string& path) {
+	LvdsSource::Settings settings{};
+	settings.path = path;
+	settings.ref_index_bits = 16;
+	settings.stop_result_bits = 20;
+	settings.max_stop_result = 200'000;
+	settings.sample_rate_hz = 1e6;
+	settings.read_size = 7;
+	LvdsSource source{ settings };
+	check(source.open(), "open the capture");
+	std::vector<SPI::GPX2_TDC::Meas> measurements{};
+	while (source.read(measurements, std::chrono::milliseconds{ 100 })) {
+	}
+
+	const Expected expected[]{ { 0, 0x1234, 0x0abcd }, { 1, 0x1234, 0x1f00f }, { 2, 0xffff, 0x00001 }, { 0, 0x0001, 0x00000 } };
+	check(measurements.size() == std::size(expected), "4 results decoded, got " + std::to_string(measurements.size()));
+	for (std::size_t i{ 0 }; i < std::min(measurements.size(), std::size(expected)); i++) {
+		const auto& meas{ measurements[i] };
+		check(meas.status == SPI::GPX2_TDC::Meas::Valid, "result " + std::to_string(i) + " valid");
+		check(static_cast<unsigned>(meas.stop_channel) == expected[i].channel, "result " + std::to_string(i) + " channel");
+		check(meas.ref_index == expected[i].ref_index, "result " + std::to_string(i) + " ref_index");
+		check(meas.stop_result == expected[i].stop_result, "result " + std::to_string(i) + " stop result");
+	}
+	if (measurements.size() == std::size(expected)) {
+		// the last bits of the first and the last result are 115 bits of two samples apart
+		const auto distance{ std::chrono::duration_cast<std::chrono::microseconds>(measurements.back().ts - measurements.front().ts) };
+		check(distance.count() == 230, "time between the results from the stream position");
+	}
+	const auto& counters{ source.counters() };
+	check(counters.bytes == 400, "all bytes read");
+	check(counters.results == 4, "results counted");
+	check(counters.resyncs == 1, "the cut off frame counted as resync");
+	check(counters.implausible == 1, "the stop result beyond the refclk divisions discarded");
+}
+
+void test_pattern() {
+	LvdsSource::Settings settings{};
+	settings.ref_index_bits = 16;
+	settings.stop_result_bits = 20;
+	settings.ddr = true;
+	settings.test_pattern = true;
+	LvdsSource source{ settings };
+	const std::uint64_t pattern{ source.settings().pattern };
+	check(pattern == 0xaaaaaaaaaULL, "default pattern of alternating bits");
+
+	// three words on stop 2, the second one with two wrong bits, with idle samples between them
+	std::vector<std::uint8_t> stream(8, 0);
+	for (const std::uint64_t word : { pattern, pattern ^ std::uint64_t{ 0x100000001 }, pattern }) {
+		for (unsigned bit{ 0 }; bit < 36; bit++) {
+			const auto data{ static_cast<std::uint8_t>(((word >> (35U - bit)) & 1U) << 1U) };
+			stream.push_back(static_cast<std::uint8_t>(data | (bit == 0 ? 0x20U : 0U)));
+		}
+		stream.insert(stream.end(), 5, 0);
+	}
+	std::vector<SPI::GPX2_TDC::Meas> measurements{};
+	source.decode(stream.data(), stream.size(), measurements);
+	const auto& counters{ source.counters() };
+	check(measurements.empty(), "no results from test pattern words");
+	check(counters.pattern_words == 3, "test pattern words counted");
+	check(counters.pattern_errors == 1, "one wrong word");
+	check(counters.pattern_bit_errors == 2, "two wrong bits");
+}
+}
+
+auto main(int argc, char** argv)->int {
+	if (argc != 2) {
+		std::cerr << "usage: " << argv[0] << " capture_file" << std::endl;
+		return 1;
+	}
+	capture(argv[1]);
+	test_pattern();
+	if (failures == 0) {
+		std::cout << "lvds capture ok" << std::endl;
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+// serves records with a NetSink on an ephemeral loopback port and reads them back with a NetReceiver:
+// the records have to arrive unchanged, and a subscriber which stalls has to see exactly the frames
+// the sink dropped for it as gaps in the sequence numbers.
+#include "net_sink.h"
+#include "net_stream.h"
+#include "reactor.h"
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+namespace {
+int failures{ 0 };
+
+void check(bool condition, const std::string& what) {
+	if (!condition) {
+		std::cerr << "failed: " << what << std::endl;
+		failures++;
+	}
+}
+
+auto make_hits(std::size_t n, std::uint64_t frame)->std::vector<Hit> {
+	std::vector<Hit> hits(n);
+	for (std::size_t i{ 0 }; i < n; i++) {
+		hits[i].time_ps = static_cast<std::int64_t>(frame * 1'000'000 + i * 100) - 500;
+		hits[i].ref_index = frame;
+		hits[i].stop_result = static_cast<std::uint32_t>(i * 7);
+		hits[i].channel = static_cast<std::uint8_t>(i % stop_channels);
+	}
+	return hits;
+}
+
+void round_trip(Reactor& reactor, NetSink& sink, NetReceiver& receiver) {
+	const auto hits{ make_hits(100, 1) };
+	CoincidenceEvent event{};
+	event.time_ps = -42;
+	event.offset_ps = { 0, 1500, -3, 2'000'000'000 };
+	event.group = 3;
+	event.channel_mask = 0b1011;
+	sink.write(hits, { event });
+	sink.flush();
+	static_cast<void>(reactor.step(std::chrono::milliseconds{ 0 }));
+
+	std::vector<NetHitRecord> received_hits{};
+	std::vector<NetCoincidenceRecord> received_events{};
+	check(receiver.next(received_hits, received_events), "receive the first frame");
+	check(received_hits.size() == hits.size(), "number of hits");
+	for (std::size_t i{ 0 }; i < std::min(hits.size(), received_hits.size()); i++) {
+		const auto& record{ received_hits[i] };
+		if (record.time_ps != hits[i].time_ps || record.ref_index != hits[i].ref_index || record.stop_result != hits[i].stop_result || record.channel != hits[i].channel) {
+			check(false, "hit " + std::to_string(i) + " unchanged");
+			break;
+		}
+	}
+	check(received_events.size() == 1, "number of coincidences");
+	if (!received_events.empty()) {
+		const auto& record{ received_events.front() };
+		bool same{ record.time_ps == event.time_ps && record.group == event.group && record.channel_mask == event.channel_mask };
+		for (std::size_t ch{ 0 }; ch < stop_channels; ch++) {
+			same = same && record.offset_ps[ch] == event.offset_ps[ch];
+		}
+		check(same, "coincidence unchanged");
+	}
+	check(receiver.lost_frames() == 0, "no frames lost while reading");
+}
+
+void stalled_subscriber(Reactor& reactor, NetSink& sink, NetReceiver& receiver) {
+	// the subscriber does not read until the socket buffers are full and the sink dropped frames for it
+	std::uint64_t frame{ 2 };
+	while (sink.counters().dropped_frames < 20 && frame < 100'000) {
+		sink.write(make_hits(2000, frame++), {});
+		sink.flush();
+		static_cast<void>(reactor.step(std::chrono::milliseconds{ 0 }));
+	}
+	check(sink.counters().dropped_frames >= 20, "frames dropped for the stalled subscriber");
+
+	// now it reads everything while the reactor sends the rest of its queue
+	const auto total{ sink.counters().frames };
+	std::atomic<bool> done{ false };
+	bool complete{ true };
+	std::thread reader{ [&] {
+		std::vector<NetHitRecord> hits{};
+		std::vector<NetCoincidenceRecord> events{};
+		while (receiver.frames() + receiver.lost_frames() < total) {
+			hits.clear();
+			if (!receiver.next(hits, events) || hits.empty() || hits.front().ref_index != receiver.frames() + receiver.lost_frames()) {
+				complete = false;
+				break;
+			}
+		}
+		done = true;
+	} };
+	const auto deadline{ std::chrono::steady_clock::now() + std::chrono::seconds{ 30 } };
+	while (!done && std::chrono::steady_clock::now() < deadline) {
+		static_cast<void>(reactor.step(std::chrono::milliseconds{ 10 }));
+	}
+	if (!done) {
+		receiver.close();
+	}
+	reader.join();
+	check(done && complete, "every frame read with the records of its sequence number");
+	check(receiver.lost_frames() == sink.counters().dropped_frames, "gaps " + std::to_string(receiver.lost_frames()) + " equal to the dropped frames " + std::to_string(sink.counters().dropped_frames));
+	check(receiver.frames() + receiver.lost_frames() == total, "received and lost frames add up to the sent ones");
+}
+}
+
+auto main()->int {
+	Reactor reactor{};
+	NetSink::Settings settings{};
+	settings.port = "0";
+	settings.queue_bytes = 1U << 20U;
+	settings.flush_interval = std::chrono::seconds{ 3600 };
+	settings.overflow = NetSink::Overflow::DropOldest;
+	NetSink sink{ settings, reactor };
+	if (!sink.open()) {
+		return 1;
+	}
+	NetReceiver receiver{};
+	if (!receiver.connect("localhost", sink.port())) {
+		return 1;
+	}
+	// accept the subscriber
+	for (int i{ 0 }; i < 100 && sink.counters().clients == 0; i++) {
+		static_cast<void>(reactor.step(std::chrono::milliseconds{ 10 }));
+	}
+	check(sink.counters().clients == 1, "subscriber accepted");
+
+	round_trip(reactor, sink, receiver);
+	stalled_subscriber(reactor, sink, receiver);
+
+	if (failures == 0) {
+		std::cout << "net loopback ok, " << sink.counters().frames << " frames, " << receiver.lost_frames() << " dropped for the stalled subscriber" << std::endl;
+	}
+	return failures == 0 ? 0 : 1;
+}
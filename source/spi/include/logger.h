@@ -0,0 +1,104 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace SPI {
+	// one call site of the logger: the format with {} for each argument and the rate limit of the site.
+	// sites have to live as long as the program, use a function local static:
+	//   static SPI::LogSite site{ "spi_xfer returned {} bytes instead of {}" };
+	//   SPI::log(site, status, n);
+	class LogSite {
+	public:
+		explicit LogSite(const char* format, std::uint32_t max_per_second = 10);
+
+		const char* const format;
+		const std::uint32_t max_per_second;
+
+	private:
+		friend class Logger;
+		std::atomic<std::int64_t> m_window_start_ns{ 0 };
+		std::atomic<std::uint32_t> m_in_window{ 0 };
+		std::atomic<std::uint64_t> m_suppressed{ 0 };
+	};
+
+	// asynchronous logger for the error paths of the acquisition.
+	// a call only copies the site and up to four integer arguments into a lock free ring of the calling thread,
+	// it never blocks and never allocates after the first call of a thread. a background thread formats
+	// the records and writes them in batches. messages over the rate limit of their site and messages
+	// which do not fit into the ring any more are counted and reported instead of written.
+	class Logger {
+	public:
+		static constexpr std::size_t max_args{ 4 };
+		static constexpr std::size_t ring_size{ 1024 }; // records per thread, power of 2
+
+		struct Record {
+			const LogSite* site{};
+			std::int64_t time_ns{}; // system clock
+			std::uint32_t args_used{};
+			std::array<std::int64_t, max_args> args{};
+		};
+
+		static auto instance()->Logger&;
+
+		~Logger();
+		Logger(const Logger&) = delete;
+		auto operator=(const Logger&)->Logger& = delete;
+
+		void log(LogSite& site, std::uint32_t args_used, const std::array<std::int64_t, max_args>& args);
+		// writes all records queued so far, waits for the background thread
+		void flush();
+		// the stream has to outlive the logger, the default is std::cerr
+		void set_output(std::ostream& out);
+		[[nodiscard]] auto dropped() const->std::uint64_t;
+
+	private:
+		struct Ring {
+			std::array<Record, ring_size> records{};
+			alignas(64) std::atomic<std::size_t> head{ 0 }; // written by the producer
+			alignas(64) std::atomic<std::size_t> tail{ 0 }; // written by the background thread
+		};
+
+		Logger();
+		auto ring()->Ring&;
+		void add_site(LogSite& site);
+		void run();
+		void drain(const std::vector<Ring*>& rings, std::string& text);
+		void report_suppressed(const std::vector<LogSite*>& sites, std::string& text);
+
+		friend class LogSite;
+
+		std::mutex m_mutex{};
+		std::condition_variable m_wake{};
+		std::vector<std::unique_ptr<Ring>> m_rings{};
+		std::vector<LogSite*> m_sites{};
+		std::ostream* m_out{};
+		std::atomic<std::uint64_t> m_dropped{ 0 };
+		std::uint64_t m_dropped_reported{ 0 };
+		std::vector<Record> m_batch{};
+		std::chrono::steady_clock::time_point m_last_report{};
+		std::uint64_t m_flush_requested{ 0 };
+		std::uint64_t m_flushed{ 0 };
+		bool m_run{ true };
+		std::thread m_thread{};
+	};
+
+	template <typename... Args>
+	void log(LogSite& site, Args... args) {
+		static_assert(sizeof...(Args) <= Logger::max_args, "at most Logger::max_args arguments");
+		static_assert((std::is_integral_v<Args> && ...) || sizeof...(Args) == 0, "only integer arguments");
+		Logger::instance().log(site, sizeof...(Args), { static_cast<std::int64_t>(args)... });
+	}
+}
+#endif // !LOGGER_H
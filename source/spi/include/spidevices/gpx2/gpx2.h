@@ -82,19 +82,37 @@ namespace SPI {
 			using spiDevice::spiDevice;
 
 			void init(std::string busAddress = "/dev/spidev0.0", std::uint32_t speed = 61035, Mode mode = SPI::Mode::spi_mode_1, std::uint8_t bits = 8);
+			// opens the bus without the power on reset, the chip keeps its config and measurement
+			void open(std::string busAddress = "/dev/spidev0.0", std::uint32_t speed = 61035, Mode mode = SPI::Mode::spi_mode_1, std::uint8_t bits = 8);
 			void power_on_reset();
 			void init_reset();
 			[[nodiscard]] auto write_config()->bool;
 			[[nodiscard]] auto write_config(const Config& data)->bool;
 			[[nodiscard]] auto read_config()->std::string;
+			// writes only the registers that differ from data and verifies them.
+			// returns the number of registers written or -1 on failure, 0 means the chip was already configured
+			[[nodiscard]] auto update_config(const Config& data)->int;
+			// known answer test of the spi link at the current speed, returns the number of wrong bits.
+			// every transfer reads back the 17 config registers and compares them with registers, a failed transfer counts all bits.
+			// with write_patterns every other transfer first writes registers with inverted refclk division registers, so both
+			// levels of those bits are tested; the chip must not be measuring then, registers are written again at the end
+			[[nodiscard]] auto transfer_test(const std::string& registers, unsigned transfers, bool write_patterns)->std::uint64_t;
+			// compares the config register reg_addr (0...16) with expected and writes it again if it differs.
+			// returns 0 if it was right, 1 if it was repaired and -1 if it still differs after the repair
+			[[nodiscard]] auto repair_register(std::uint8_t reg_addr, std::uint8_t expected)->int;
+			// reads and discards results until the fifos are empty or max_reads is reached, returns the number of valid results
+			auto discard_results(unsigned max_reads = 64)->std::size_t;
 			[[nodiscard]] auto get_filtered_intervals(double max_interval)->std::vector<double>;
 			[[nodiscard]] auto read_results()->std::vector<Meas>;
+			// reads only the results of the first channels (1...4), e.g. 2 if only the channel pair of stop 1 is combined
+			[[nodiscard]] auto read_results(std::size_t channels)->std::vector<Meas>;
 		private:
 			[[nodiscard]] auto write_config(const std::string& data)->bool;
 			[[nodiscard]] auto write_config(const std::uint8_t reg_addr, const std::uint8_t data)->bool;
 			[[nodiscard]] auto read_config(const std::uint8_t reg_addr)->std::uint8_t;
 			std::queue<Meas> readout_buffer;
 			Config config;
+			double lsb_ps{ 1. }; // updated on every config write, so it is not recalculated for each result
 		};
 	}
 }
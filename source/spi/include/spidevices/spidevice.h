@@ -53,6 +53,13 @@ namespace SPI {
 
 		virtual auto devicePresent()->bool;
 
+		/**
+		* Changes the clock of all following transfers
+		* @param speed in Hz
+		*/
+		void set_speed(std::uint32_t speed);
+		[[nodiscard]] auto speed() const->std::uint32_t;
+
 	protected:
 		static auto spi_xfer(const int handle, const uint32_t speed, const uint8_t mode, const uint8_t bits, const uint8_t* tx, uint8_t* rx, uint32_t nBytes)->int;
 
@@ -0,0 +1,185 @@
+#include "logger.h"
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+
+using namespace SPI;
+
+namespace {
+constexpr std::chrono::milliseconds write_period{ 50 };
+constexpr std::chrono::seconds report_period{ 1 };
+
+void append_time(std::int64_t time_ns, std::string& text) {
+	const std::time_t seconds{ static_cast<std::time_t>(time_ns / 1'000'000'000) };
+	std::tm local{};
+	localtime_r(&seconds, &local);
+	char buffer[32]{};
+	const auto n{ std::strftime(buffer, sizeof(buffer), "%F %T", &local) };
+	text.append(buffer, n);
+	const auto ms{ std::to_string(time_ns / 1'000'000 % 1000) };
+	text += "." + std::string(3 - ms.size(), '0') + ms + " ";
+}
+}
+
+LogSite::LogSite(const char* format_, std::uint32_t max_per_second_)
+	: format{ format_ }
+	, max_per_second{ max_per_second_ }
+{
+	Logger::instance().add_site(*this);
+}
+
+auto Logger::instance()->Logger& {
+	static Logger logger{};
+	return logger;
+}
+
+Logger::Logger()
+	: m_out{ &std::cerr }
+	, m_thread{ [this] { run(); } }
+{
+}
+
+Logger::~Logger() {
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_run = false;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+}
+
+void Logger::log(LogSite& site, std::uint32_t args_used, const std::array<std::int64_t, max_args>& args) {
+	const std::int64_t now{ std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() };
+	auto start{ site.m_window_start_ns.load(std::memory_order_relaxed) };
+	if (now - start >= 1'000'000'000 && site.m_window_start_ns.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+		site.m_in_window.store(0, std::memory_order_relaxed);
+	}
+	if (site.m_in_window.fetch_add(1, std::memory_order_relaxed) >= site.max_per_second) {
+		site.m_suppressed.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	auto& r{ ring() };
+	const auto head{ r.head.load(std::memory_order_relaxed) };
+	if (head - r.tail.load(std::memory_order_acquire) >= ring_size) {
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	auto& record{ r.records[head & (ring_size - 1)] };
+	record.site = &site;
+	record.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	record.args_used = args_used;
+	record.args = args;
+	r.head.store(head + 1, std::memory_order_release);
+}
+
+void Logger::flush() {
+	std::unique_lock<std::mutex> lock{ m_mutex };
+	const auto ticket{ ++m_flush_requested };
+	m_wake.notify_all();
+	m_wake.wait(lock, [&] { return m_flushed >= ticket || !m_run; });
+}
+
+void Logger::set_output(std::ostream& out) {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	m_out = &out;
+}
+
+auto Logger::dropped() const->std::uint64_t {
+	return m_dropped.load(std::memory_order_relaxed);
+}
+
+auto Logger::ring()->Ring& {
+	// the ring of a thread is kept after the thread ends, records may still be in it
+	thread_local Ring* ring{ nullptr };
+	if (ring == nullptr) {
+		auto created{ std::make_unique<Ring>() };
+		ring = created.get();
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_rings.push_back(std::move(created));
+	}
+	return *ring;
+}
+
+void Logger::add_site(LogSite& site) {
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	m_sites.push_back(&site);
+}
+
+void Logger::run() {
+	std::string text{};
+	std::vector<Ring*> rings{};
+	std::vector<LogSite*> sites{};
+	std::unique_lock<std::mutex> lock{ m_mutex };
+	while (true) {
+		m_wake.wait_for(lock, write_period, [&] { return !m_run || m_flush_requested != m_flushed; });
+		const bool stop{ !m_run };
+		const auto request{ m_flush_requested };
+		rings.clear();
+		for (const auto& ring : m_rings) {
+			rings.push_back(ring.get());
+		}
+		sites = m_sites;
+		std::ostream* out{ m_out };
+		lock.unlock();
+
+		text.clear();
+		drain(rings, text);
+		report_suppressed(sites, text);
+		if (!text.empty()) {
+			*out << text << std::flush;
+		}
+
+		lock.lock();
+		m_flushed = request;
+		m_wake.notify_all();
+		if (stop) {
+			return;
+		}
+	}
+}
+
+void Logger::drain(const std::vector<Ring*>& rings, std::string& text) {
+	m_batch.clear();
+	for (auto* ring : rings) {
+		const auto tail{ ring->tail.load(std::memory_order_relaxed) };
+		const auto head{ ring->head.load(std::memory_order_acquire) };
+		for (auto i{ tail }; i != head; i++) {
+			m_batch.push_back(ring->records[i & (ring_size - 1)]);
+		}
+		ring->tail.store(head, std::memory_order_release);
+	}
+	// the threads log into separate rings, the messages are written in time order
+	std::stable_sort(m_batch.begin(), m_batch.end(), [](const Record& a, const Record& b) { return a.time_ns < b.time_ns; });
+	for (const auto& record : m_batch) {
+		append_time(record.time_ns, text);
+		std::uint32_t arg{ 0 };
+		for (const char* c{ record.site->format }; *c != '\0'; c++) {
+			if (c[0] == '{' && c[1] == '}' && arg < record.args_used) {
+				text += std::to_string(record.args[arg++]);
+				c++;
+			} else {
+				text += *c;
+			}
+		}
+		text += '\n';
+	}
+}
+
+void Logger::report_suppressed(const std::vector<LogSite*>& sites, std::string& text) {
+	const auto now{ std::chrono::steady_clock::now() };
+	if (now - m_last_report < report_period) {
+		return;
+	}
+	m_last_report = now;
+	for (auto* site : sites) {
+		const auto suppressed{ site->m_suppressed.exchange(0, std::memory_order_relaxed) };
+		if (suppressed > 0) {
+			text += "suppressed " + std::to_string(suppressed) + " more messages like: " + site->format + "\n";
+		}
+	}
+	const auto dropped{ m_dropped.load(std::memory_order_relaxed) };
+	if (dropped != m_dropped_reported) {
+		text += std::to_string(dropped - m_dropped_reported) + " log messages dropped, the log ring of a thread was full\n";
+		m_dropped_reported = dropped;
+	}
+}
@@ -1,8 +1,11 @@
 #include "spidevices/gpx2/gpx2.h"
 #include "spidevices/gpx2/config.h"
+#include "logger.h"
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <algorithm>
+#include <bitset>
 
 using namespace SPI::GPX2_TDC;
 
@@ -11,6 +14,10 @@ void GPX2::init(std::string busAddress, std::uint32_t speed, Mode mode, std::uin
 	power_on_reset();
 }
 
+void GPX2::open(std::string busAddress, std::uint32_t speed, Mode mode, std::uint8_t bits) {
+	spiDevice::init(busAddress, speed, mode, bits);
+}
+
 void GPX2::power_on_reset() {
 	write(spiopc_power, "");
 }
@@ -25,12 +32,16 @@ auto GPX2::write_config()->bool {
 
 auto GPX2::write_config(const Config& data)->bool {
 	config = data;
+	if (config.refclk_divisions() != 0) {
+		lsb_ps = 1e12 / (config.refclk_divisions() * config.refclk_freq);
+	}
 	return write_config(data.str());
 }
 
 auto GPX2::write_config(const std::string& data)->bool {
 	if (data.size() != 17) {
-		std::cerr << "write all of the config only possible if 17 bytes of data provided\n";
+		static LogSite site{ "write all of the config only possible if 17 bytes of data provided, got {}" };
+		log(site, data.size());
 		return false;
 	}
 	return write(spiopc_write_config, data);
@@ -38,7 +49,8 @@ auto GPX2::write_config(const std::string& data)->bool {
 
 auto GPX2::write_config(const std::uint8_t reg_addr, const std::uint8_t data)->bool {
 	if (reg_addr > 16) {
-		std::cerr << "write config is only possible on register addr. 0...16\n";
+		static LogSite site{ "write config is only possible on register addr. 0...16, got {}" };
+		log(site, reg_addr);
 		return false;
 	}
 	std::string conf_str = std::string({ static_cast<char>(data) });
@@ -49,9 +61,95 @@ auto GPX2::read_config()->std::string {
 	return read(spiopc_read_config, 17);
 }
 
+auto GPX2::update_config(const Config& data)->int {
+	const std::string wanted{ data.str() };
+	const std::string current{ read_config() };
+	if (current.size() != wanted.size()) {
+		std::cerr << "could not read the config of the gpx2\n";
+		return -1;
+	}
+	int written{ 0 };
+	for (std::uint8_t reg_addr{ 0 }; reg_addr < wanted.size(); reg_addr++) {
+		if (current[reg_addr] == wanted[reg_addr]) {
+			continue;
+		}
+		if (!write_config(reg_addr, static_cast<std::uint8_t>(wanted[reg_addr]))) {
+			return -1;
+		}
+		written++;
+	}
+	if (written > 0 && read_config() != wanted) {
+		std::cerr << "config registers could not be updated\n";
+		return -1;
+	}
+	config = data;
+	if (config.refclk_divisions() != 0) {
+		lsb_ps = 1e12 / (config.refclk_divisions() * config.refclk_freq);
+	}
+	return written;
+}
+
+auto GPX2::repair_register(std::uint8_t reg_addr, std::uint8_t expected)->int {
+	if (read_config(reg_addr) == expected) {
+		return 0;
+	}
+	if (!write_config(reg_addr, expected) || read_config(reg_addr) != expected) {
+		return -1;
+	}
+	return 1;
+}
+
+auto GPX2::transfer_test(const std::string& registers, unsigned transfers, bool write_patterns)->std::uint64_t {
+	const std::string& wanted{ registers };
+	if (wanted.size() != 17) {
+		return std::numeric_limits<std::uint64_t>::max();
+	}
+	std::string inverted{ wanted };
+	inverted[3] = static_cast<char>(~inverted[3]);
+	inverted[4] = static_cast<char>(~inverted[4]);
+	std::uint64_t wrong_bits{ 0 };
+	for (unsigned i{ 0 }; i < transfers; i++) {
+		const std::string& expected{ (write_patterns && i % 2 == 1) ? inverted : wanted };
+		if (write_patterns && !write_config(expected)) {
+			wrong_bits += 8U * expected.size();
+			continue;
+		}
+		const std::string current{ read_config() };
+		if (current.size() != expected.size()) {
+			wrong_bits += 8U * expected.size();
+			continue;
+		}
+		for (std::size_t b{ 0 }; b < expected.size(); b++) {
+			wrong_bits += std::bitset<8>(static_cast<unsigned char>(current[b] ^ expected[b])).count();
+		}
+	}
+	if (write_patterns && !write_config(wanted)) {
+		wrong_bits += 8U * wanted.size();
+	}
+	return wrong_bits;
+}
+
+auto GPX2::discard_results(unsigned max_reads)->std::size_t {
+	std::size_t valid{ 0 };
+	for (unsigned i{ 0 }; i < max_reads; i++) {
+		std::size_t found{ 0 };
+		for (auto& meas : read_results()) {
+			if (meas) {
+				found++;
+			}
+		}
+		if (found == 0) {
+			break;
+		}
+		valid += found;
+	}
+	return valid;
+}
+
 auto GPX2::read_config(const std::uint8_t reg_addr)->std::uint8_t {
 	if (reg_addr > 16) {
-		std::cerr << "read config is only possible on register addr. 0...16\n";
+		static LogSite site{ "read config is only possible on register addr. 0...16, got {}" };
+		log(site, reg_addr);
 		return 0;
 	}
 	std::string data = read(spiopc_read_config | reg_addr, 1);
@@ -62,7 +160,12 @@ auto GPX2::read_config(const std::uint8_t reg_addr)->std::uint8_t {
 }
 
 auto GPX2::read_results()->std::vector<Meas> {
-	std::string readout = read(spiopc_read_results | 0x08U, 24);
+	return read_results(4);
+}
+
+auto GPX2::read_results(std::size_t channels)->std::vector<Meas> {
+	channels = std::min<std::size_t>(channels, 4);
+	std::string readout = read(spiopc_read_results | 0x08U, channels * 6U);
 	/*for (unsigned i = 0; i < 24; i++) {
 		std::cout << std::setw(2) << std::dec << i << ": " << std::hex << std::setw(2) << std::setfill('0') << static_cast<unsigned>(readout[i]) << std::endl;
 	}*/
@@ -80,10 +183,10 @@ auto GPX2::read_results()->std::vector<Meas> {
 	if (readout.empty()) {
 		return measurements;
 	}
-	double lsb_ps = 1e12 / (config.refclk_divisions() * config.refclk_freq);
-	for (std::size_t i = 0; i < 4; i++) {
+	for (std::size_t i = 0; i < channels; i++) {
 		Meas meas;
 		meas.status = Meas::Valid;
+		meas.stop_channel = static_cast<StopChannel>(i);
 		meas.lsb_ps = lsb_ps;
 		meas.refclk_freq = config.refclk_freq;
 
@@ -1,7 +1,9 @@
 #include "spidevices/spidevice.h"
+#include "logger.h"
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <cerrno>
 #include <iostream>
 #include <memory>
 #include <unistd.h>
@@ -108,9 +110,18 @@ auto spiDevice::devicePresent()->bool {
 	return false;
 }
 
+void spiDevice::set_speed(std::uint32_t speed) {
+	fSpeed = speed;
+}
+
+auto spiDevice::speed() const->std::uint32_t {
+	return fSpeed;
+}
+
 auto spiDevice::write(const std::uint8_t command, const std::string& data)->bool {
 	if (fHandle==-1) {
-		std::cerr << "tried to write to spi without initialising (calling init(..) first)." << std::endl;
+		static LogSite site{ "tried to write to spi without initialising (calling init(..) first)." };
+		log(site);
 		return false;
 	}
 	const std::size_t n = data.size() + 1;
@@ -124,7 +135,8 @@ auto spiDevice::write(const std::uint8_t command, const std::string& data)->bool
 
 	auto status = spi_xfer(fHandle, fSpeed, fMode, fNrBits, txBuf.get(), rxBuf.get(), n);
 	if (status != static_cast<decltype(status)>(n)) {
-		std::cerr << "transfer size mismatch: spi_xfer returned " << status << " bytes transfered but should write" << n << " bytes." << std::endl;
+		static LogSite site{ "transfer size mismatch: spi_xfer returned {} bytes transfered but should write {} bytes." };
+		log(site, status, n);
 		return false;
 	}
 	return true;
@@ -132,7 +144,8 @@ auto spiDevice::write(const std::uint8_t command, const std::string& data)->bool
 
 auto spiDevice::read(const std::uint8_t command, const std::size_t nBytes)->std::string {
 	if (fHandle == -1) {
-		std::cerr << "tried to read from spi without initialising." << std::endl;
+		static LogSite site{ "tried to read from spi without initialising." };
+		log(site);
 		return "";
 	}
 	const std::size_t n = nBytes + 1;
@@ -143,7 +156,8 @@ auto spiDevice::read(const std::uint8_t command, const std::size_t nBytes)->std:
 
 	auto status = spi_xfer(fHandle, fSpeed, fMode, fNrBits, txBuf.get(), rxBuf.get(), n);
 	if (status != static_cast<decltype(status)>(n)) {
-		std::cerr << "transfer size mismatch: spi_xfer returned " << status <<" bytes but should read" << n <<" bytes." << std::endl;
+		static LogSite site{ "transfer size mismatch: spi_xfer returned {} bytes but should read {} bytes." };
+		log(site, status, n);
 		return "";
 	}
 	std::string data;
@@ -178,7 +192,8 @@ auto spiDevice::spi_xfer(const int handle, const uint32_t speed, const uint8_t m
 
 	ret = ioctl(handle, SPI_IOC_MESSAGE(1), &tr);
 	if (ret < 1) {
-		std::cerr << "can't send spi message" << std::endl;
+		static LogSite site{ "can't send spi message, errno {}" };
+		log(site, errno);
 	}
 	return ret;
 }
\ No newline at end of file